@@ -68,7 +68,7 @@ int open_file(char* path, char* flags) {
   int retval;
   asm volatile("  mv a0,%0" : : "r" (path) : "a0");
   asm volatile("  mv a1,%0" : : "r" (flags) : "a1");
-  asm volatile("  li a7,6" : : : "a7");
+  asm volatile("  li a7,8" : : : "a7");
   asm volatile("  ecall" : : : "a0");
   asm volatile("  mv %0,a0" : "=r" (retval));
   return retval;
@@ -84,8 +84,11 @@ int close_file(int file) {
 }
 
 
+// the whole string goes to the simulator in one ecall
 void print_string(const char* p) {
-  while (*p) { outp(*p++); };
+  asm volatile("  mv a0,%0" : : "r" (p) : "a0");
+  asm volatile("  li a7,7" : : : "a7");
+  asm volatile("  ecall" : : : "a0");
 }
 
 void read_string(char* buffer, int max_chars) {
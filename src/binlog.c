@@ -0,0 +1,61 @@
+#include "binlog.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define BUFFSIZE 120 // line buffer of the original -l writer, whose truncation rules still apply
+
+// write() everything, retrying short writes
+static int write_all(int fd, const void *data, size_t len) {
+  const char *p = data;
+  while (len) {
+    ssize_t done = write(fd, p, len);
+    if (done <= 0)
+      return -1;
+    p += done;
+    len -= done;
+  }
+  return 0;
+}
+
+struct binlog *binlog_create(const char *name) {
+  int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return NULL;
+  const unsigned char header[BINLOG_HEADER_SIZE] = {
+      'R', 'V', 'B', 'L', BINLOG_VERSION, sizeof(struct binlog_record), 0, 0};
+  struct binlog *log = malloc(sizeof(struct binlog));
+  log->fd = fd;
+  log->fill = 0;
+  log->failed = write_all(fd, header, sizeof(header)) < 0;
+  return log;
+}
+
+void binlog_flush(struct binlog *log) {
+  if (write_all(log->fd, log->buffer, log->fill * sizeof(struct binlog_record)) < 0)
+    log->failed = 1;
+  log->fill = 0;
+}
+
+int binlog_close(struct binlog *log) {
+  binlog_flush(log);
+  int failed = log->failed | (close(log->fd) < 0);
+  free(log);
+  return failed ? -1 : 0;
+}
+
+void binlog_render(struct disasm_cache *cache, const struct binlog_record *r, int previous_flag,
+                   FILE *out) {
+  fprintf(out, "%ld%s%08x  :  0x%08X     ", (long int)r->insns,
+          previous_flag == 1 ? " => " : "    ", r->pc, r->raw);
+  size_t len;
+  const char *text = disasm_cache_lookup(cache, r->pc, r->raw, &len);
+  if (text)
+    fwrite(text, 1, len, out);
+  if (r->flag && len + 6 < BUFFSIZE) {
+    fwrite("   {T}", 1, 6, out);
+    len += 6;
+  }
+  if (len + 1 < BUFFSIZE)
+    putc('\n', out);
+}
@@ -0,0 +1,60 @@
+#ifndef __BINLOG_H__
+#define __BINLOG_H__
+
+#include "disassemble.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Binary instruction log (sim -L), the fast alternative to the text log of -l. One fixed size
+// record per executed instruction holds what the text log is made from; the simlog tool
+// renders a binary log to exactly the text -l writes.
+//
+// The file starts with an 8 byte header, "RVBL", a version byte, the record size and two zero
+// bytes, followed by records in host byte order.
+
+#define BINLOG_VERSION 1
+#define BINLOG_HEADER_SIZE 8
+#define BINLOG_BUFFER_RECORDS 65536 // records collected before each write()
+
+struct binlog_record {
+  uint64_t insns;    // instructions executed before this one
+  uint32_t pc;       // pc after execution, which the text log shows
+  uint32_t raw;      // instruction word
+  uint32_t rd_value; // destination register after execution
+  uint8_t flag;      // the handler's log flag (2 for jumps); nonzero adds {T}
+  uint8_t pad[3];
+};
+
+struct binlog {
+  int fd;
+  int failed;
+  size_t fill;
+  struct binlog_record buffer[BINLOG_BUFFER_RECORDS];
+};
+
+// Returns NULL if the file cannot be created
+struct binlog *binlog_create(const char *name);
+void binlog_flush(struct binlog *log);
+// Flush, close and free. Returns 0 on success, -1 if anything could not be written.
+int binlog_close(struct binlog *log);
+
+// Write one record as a line of the -l text log. previous_flag is the flag of the record
+// before it (0 for the first), which decides the " => " marker. The disassembly comes from
+// the cache.
+void binlog_render(struct disasm_cache *cache, const struct binlog_record *r, int previous_flag,
+                   FILE *out);
+
+static inline void binlog_write(struct binlog *log, uint64_t insns, uint32_t pc, uint32_t raw,
+                                uint32_t rd_value, int flag) {
+  struct binlog_record *r = &log->buffer[log->fill];
+  r->insns = insns;
+  r->pc = pc;
+  r->raw = raw;
+  r->rd_value = rd_value;
+  r->flag = flag;
+  r->pad[0] = r->pad[1] = r->pad[2] = 0;
+  if (++log->fill == BINLOG_BUFFER_RECORDS)
+    binlog_flush(log);
+}
+
+#endif
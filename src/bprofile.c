@@ -0,0 +1,135 @@
+#include "bprofile.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BPROFILE_INITIAL_CAPACITY 1024
+#define BPROFILE_SYMBOL_SEARCH 0x10000 // how far back from a branch to look for its function
+
+static void bprofile_alloc(struct bprofile *profile, unsigned int capacity) {
+  profile->capacity = capacity;
+  profile->used = 0;
+  profile->entries = calloc(capacity, sizeof(struct bprofile_entry));
+  profile->misses = calloc((size_t)capacity * profile->num_predictors, sizeof(long int));
+}
+
+struct bprofile *bprofile_create(int num_predictors) {
+  struct bprofile *profile = calloc(1, sizeof(struct bprofile));
+  profile->num_predictors = num_predictors;
+  bprofile_alloc(profile, BPROFILE_INITIAL_CAPACITY);
+  return profile;
+}
+
+void bprofile_delete(struct bprofile *profile) {
+  free(profile->entries);
+  free(profile->misses);
+  free(profile);
+}
+
+void bprofile_reset(struct bprofile *profile) {
+  memset(profile->entries, 0, profile->capacity * sizeof(struct bprofile_entry));
+  memset(profile->misses, 0,
+         (size_t)profile->capacity * profile->num_predictors * sizeof(long int));
+  profile->used = 0;
+}
+
+void bprofile_grow(struct bprofile *profile) {
+  struct bprofile_entry *old_entries = profile->entries;
+  long int *old_misses = profile->misses;
+  unsigned int old_capacity = profile->capacity;
+  int n = profile->num_predictors;
+  bprofile_alloc(profile, old_capacity * 2);
+  for (unsigned int i = 0; i < old_capacity; i++) {
+    if (old_entries[i].executions == 0)
+      continue;
+    struct bprofile_entry *e = bprofile_lookup(profile, old_entries[i].pc);
+    *e = old_entries[i];
+    memcpy(bprofile_misses(profile, e), &old_misses[(size_t)i * n], n * sizeof(long int));
+  }
+  free(old_entries);
+  free(old_misses);
+}
+
+// Name the function holding pc, or else search back for the nearest symbol (such as _start,
+// which has no size)
+static void bprofile_locate(struct symbols *symbols, uint32_t pc, char *buf, size_t size) {
+  if (symbols) {
+    unsigned int func_offset;
+    const char *func = symbols_addr_to_func(symbols, pc, &func_offset);
+    if (func) {
+      snprintf(buf, size, "%s+%u", func, func_offset);
+      return;
+    }
+    for (uint32_t offset = 0; offset <= BPROFILE_SYMBOL_SEARCH && offset <= pc; offset += 4) {
+      const char *name = symbols_value_to_sym(symbols, pc - offset);
+      if (name) {
+        snprintf(buf, size, "%s+%u", name, offset);
+        return;
+      }
+    }
+  }
+  snprintf(buf, size, "?");
+}
+
+struct bprofile_rank {
+  unsigned int slot;
+  uint32_t pc;
+  long int misses;
+};
+
+// Most misses first, ties by address
+static int bprofile_compare(const void *a, const void *b) {
+  const struct bprofile_rank *x = a;
+  const struct bprofile_rank *y = b;
+  if (x->misses != y->misses)
+    return x->misses < y->misses ? 1 : -1;
+  return (x->pc > y->pc) - (x->pc < y->pc);
+}
+
+void bprofile_print(struct bprofile *profile, struct predictor_set *predictors,
+                    struct symbols *symbols, int top_n, FILE *out) {
+  int n = profile->num_predictors;
+  if (n == 0 || profile->used == 0)
+    return;
+  int best = 0;
+  for (int i = 1; i < n; i++) {
+    if (predictors->items[i]->wrong < predictors->items[best]->wrong)
+      best = i;
+  }
+  struct bprofile_rank *ranks = malloc(profile->used * sizeof(struct bprofile_rank));
+  unsigned int count = 0;
+  for (unsigned int slot = 0; slot < profile->capacity; slot++) {
+    if (profile->entries[slot].executions == 0)
+      continue;
+    ranks[count].slot = slot;
+    ranks[count].pc = profile->entries[slot].pc;
+    ranks[count].misses = profile->misses[(size_t)slot * n + best];
+    count++;
+  }
+  qsort(ranks, count, sizeof(struct bprofile_rank), bprofile_compare);
+  if ((unsigned int)top_n < count)
+    count = top_n;
+
+  fprintf(out, "\nMost mispredicted of %u branches, ranked by %s\n", profile->used,
+          predictors->items[best]->name);
+  fprintf(out, "%8s  %-28s %12s %7s", "pc", "location", "executions", "taken");
+  for (int i = 0; i < n; i++)
+    fprintf(out, " %*s", (int)strlen(predictors->items[i]->name) < 10
+                             ? 10
+                             : (int)strlen(predictors->items[i]->name),
+            predictors->items[i]->name);
+  fprintf(out, "\n");
+  for (unsigned int r = 0; r < count; r++) {
+    const struct bprofile_entry *e = &profile->entries[ranks[r].slot];
+    const long int *misses = &profile->misses[(size_t)ranks[r].slot * n];
+    char location[64];
+    bprofile_locate(symbols, e->pc, location, sizeof(location));
+    fprintf(out, "%8x  %-28s %12ld %6.1f%%", e->pc, location, e->executions,
+            100.0 * e->taken / e->executions);
+    for (int i = 0; i < n; i++) {
+      int width = strlen(predictors->items[i]->name);
+      fprintf(out, " %*ld", width < 10 ? 10 : width, misses[i]);
+    }
+    fprintf(out, "\n");
+  }
+  free(ranks);
+}
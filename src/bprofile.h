@@ -0,0 +1,64 @@
+#ifndef __BPROFILE_H__
+#define __BPROFILE_H__
+
+#include "predictor.h"
+#include "read_elf.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Per static branch profile: executions, taken count and misses for every predictor in a set.
+// Branches live in an open-addressing table keyed by pc with linear probing; the table and the
+// miss counters are arrays that double when the table is 3/4 full, so nothing is allocated per
+// branch.
+
+struct bprofile_entry {
+  uint32_t pc; // address of the branch itself
+  long int executions; // 0 for an empty slot
+  long int taken;
+};
+
+struct bprofile {
+  unsigned int capacity; // power of two
+  unsigned int used;
+  int num_predictors;
+  struct bprofile_entry *entries;
+  long int *misses; // num_predictors counters per entry
+};
+
+struct bprofile *bprofile_create(int num_predictors);
+void bprofile_delete(struct bprofile *profile);
+void bprofile_reset(struct bprofile *profile);
+
+void bprofile_grow(struct bprofile *profile);
+
+// Find or insert the branch at pc; its miss counters are bprofile_misses()
+static inline struct bprofile_entry *bprofile_lookup(struct bprofile *profile, uint32_t pc) {
+  unsigned int mask = profile->capacity - 1;
+  unsigned int slot = ((pc >> 2) * 0x9e3779b1u) >> 8 & mask;
+  for (;;) {
+    struct bprofile_entry *e = &profile->entries[slot];
+    if (e->pc == pc && e->executions)
+      return e;
+    if (e->executions == 0) {
+      if (4 * (profile->used + 1) > 3 * profile->capacity) {
+        bprofile_grow(profile);
+        return bprofile_lookup(profile, pc);
+      }
+      profile->used++;
+      e->pc = pc;
+      return e;
+    }
+    slot = (slot + 1) & mask;
+  }
+}
+
+static inline long int *bprofile_misses(struct bprofile *profile, struct bprofile_entry *e) {
+  return &profile->misses[(e - profile->entries) * profile->num_predictors];
+}
+
+// The top_n branches the most accurate predictor of the set misses most often, with every
+// predictor's misses, located as function+offset when symbols are given
+void bprofile_print(struct bprofile *profile, struct predictor_set *predictors,
+                    struct symbols *symbols, int top_n, FILE *out);
+
+#endif
@@ -0,0 +1,137 @@
+#include "btb.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *replacement_names[] = {"lru", "fifo", "random"};
+
+struct btb *btb_create(const char *spec) {
+  unsigned long sets = 64, ways = 4, ras = 16;
+  enum btb_replacement replacement = BTB_LRU;
+  const char *arg = strcmp(spec, "default") ? spec : "";
+  while (*arg) {
+    size_t key_len = strcspn(arg, "=,");
+    const char *value = arg + key_len + 1;
+    size_t value_len = strcspn(value, ",");
+    if (arg[key_len] != '=') {
+      fprintf(stderr, "Malformed BTB parameter in '%s'\n", spec);
+      return NULL;
+    }
+    char *end;
+    unsigned long number = strtoul(value, &end, 0);
+    int numeric = end == value + value_len && value_len > 0;
+    if (key_len == 4 && !strncmp(arg, "sets", 4) && numeric && number &&
+        !(number & (number - 1)) && number <= (1ul << 20)) {
+      sets = number;
+    } else if (key_len == 4 && !strncmp(arg, "ways", 4) && numeric && number >= 1 &&
+               number <= 64) {
+      ways = number;
+    } else if (key_len == 3 && !strncmp(arg, "ras", 3) && numeric && number <= 4096) {
+      ras = number;
+    } else if (key_len == 4 && !strncmp(arg, "repl", 4)) {
+      int found = 0;
+      for (int r = BTB_LRU; r <= BTB_RANDOM; r++) {
+        if (strlen(replacement_names[r]) == value_len &&
+            !strncmp(value, replacement_names[r], value_len)) {
+          replacement = r;
+          found = 1;
+        }
+      }
+      if (!found) {
+        fprintf(stderr, "BTB replacement must be lru, fifo or random\n");
+        return NULL;
+      }
+    } else {
+      fprintf(stderr, "Bad BTB parameter '%.*s' in '%s'\n", (int)key_len, arg, spec);
+      return NULL;
+    }
+    arg = value + value_len;
+    if (*arg == ',')
+      arg++;
+  }
+  struct btb *btb = calloc(1, sizeof(struct btb));
+  btb->sets = sets;
+  btb->ways = ways;
+  btb->replacement = replacement;
+  btb->entries = malloc(sets * ways * sizeof(struct btb_entry));
+  btb->ras_depth = ras;
+  btb->ras = malloc((ras ? ras : 1) * sizeof(uint32_t));
+  btb_reset(btb);
+  return btb;
+}
+
+void btb_delete(struct btb *btb) {
+  free(btb->entries);
+  free(btb->ras);
+  free(btb);
+}
+
+void btb_reset(struct btb *btb) {
+  memset(btb->entries, 0, btb->sets * btb->ways * sizeof(struct btb_entry));
+  btb->clock = 0;
+  btb->lfsr = 0xace1u;
+  btb->ras_top = 0;
+  btb->ras_count = 0;
+}
+
+static inline int is_link(int reg) { return reg == 1 || reg == 5; }
+
+static void ras_push(struct btb *btb, uint32_t address) {
+  if (btb->ras_depth == 0)
+    return;
+  btb->ras[btb->ras_top++ % btb->ras_depth] = address;
+  if (btb->ras_count < btb->ras_depth)
+    btb->ras_count++;
+}
+
+// The predicted return address, 0 when the stack has run dry
+static uint32_t ras_pop(struct btb *btb) {
+  if (btb->ras_count == 0)
+    return 0;
+  btb->ras_count--;
+  return btb->ras[--btb->ras_top % btb->ras_depth];
+}
+
+static enum btb_outcome btb_lookup(struct btb *btb, uint32_t pc, uint32_t target) {
+  struct btb_entry *set = &btb->entries[((pc >> 2) & (btb->sets - 1)) * btb->ways];
+  uint64_t now = ++btb->clock;
+  struct btb_entry *victim = &set[0];
+  for (unsigned int w = 0; w < btb->ways; w++) {
+    struct btb_entry *e = &set[w];
+    if (e->stamp && e->pc == pc) {
+      int hit = e->target == target;
+      e->target = target;
+      if (btb->replacement == BTB_LRU)
+        e->stamp = now;
+      return hit ? BTB_HIT : BTB_WRONG;
+    }
+    // Prefer an empty way, then the oldest stamp
+    if (victim->stamp && (!e->stamp || e->stamp < victim->stamp))
+      victim = e;
+  }
+  if (btb->replacement == BTB_RANDOM && victim->stamp) {
+    btb->lfsr = (btb->lfsr >> 1) ^ (-(btb->lfsr & 1) & 0xb400u);
+    victim = &set[btb->lfsr % btb->ways];
+  }
+  victim->pc = pc;
+  victim->target = target;
+  victim->stamp = now;
+  return BTB_WRONG;
+}
+
+enum btb_outcome btb_jump(struct btb *btb, uint32_t pc, uint32_t target, int rd, int rs1) {
+  int push = is_link(rd);
+  int pop = rs1 >= 0 && is_link(rs1) && (!push || rd != rs1);
+  enum btb_outcome outcome;
+  if (pop)
+    outcome = ras_pop(btb) == target ? RAS_HIT : RAS_WRONG;
+  else
+    outcome = btb_lookup(btb, pc, target);
+  if (push)
+    ras_push(btb, pc + 4);
+  return outcome;
+}
+
+void btb_describe(struct btb *btb, FILE *out) {
+  fprintf(out, "BTB %u sets x %u ways %s, RAS %u entries\n", btb->sets, btb->ways,
+          replacement_names[btb->replacement], btb->ras_depth);
+}
@@ -0,0 +1,48 @@
+#ifndef __BTB_H__
+#define __BTB_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Target prediction for jal and jalr: a set-associative branch target buffer plus a return
+// address stack. Calls and returns are recognised from the link registers (ra and t0) in rd
+// and rs1, following the hints in the RISC-V spec. Returns are predicted by the stack, every
+// other jump by the BTB.
+
+enum btb_replacement { BTB_LRU, BTB_FIFO, BTB_RANDOM };
+
+struct btb_entry {
+  uint32_t pc; // full address as tag
+  uint32_t target;
+  uint64_t stamp; // last use (LRU) or insertion (FIFO), 0 when the entry is empty
+};
+
+struct btb {
+  unsigned int sets;
+  unsigned int ways;
+  enum btb_replacement replacement;
+  uint64_t clock;
+  uint32_t lfsr;
+  struct btb_entry *entries; // sets * ways
+  unsigned int ras_depth;
+  unsigned int ras_top;   // pushes minus pops, wrapping; the stack overwrites its oldest entry
+  unsigned int ras_count; // valid entries, at most ras_depth
+  uint32_t *ras;
+};
+
+// Create from "sets=N,ways=N,repl=lru|fifo|random,ras=N", any of them left out, or "default":
+// 64 sets, 4 ways, LRU and a 16-entry stack. Reports to stderr and returns NULL on a bad spec.
+struct btb *btb_create(const char *spec);
+void btb_delete(struct btb *btb);
+void btb_reset(struct btb *btb);
+
+// What happened to a jump, for the counters in struct Stat
+enum btb_outcome { BTB_HIT, BTB_WRONG, RAS_HIT, RAS_WRONG };
+
+// Predict the jump at pc, then train with the actual target. rs1 is -1 for jal.
+enum btb_outcome btb_jump(struct btb *btb, uint32_t pc, uint32_t target, int rd, int rs1);
+
+// One line describing the configuration
+void btb_describe(struct btb *btb, FILE *out);
+
+#endif
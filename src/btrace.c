@@ -0,0 +1,138 @@
+#include "btrace.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BTRACE_VERSION 1
+#define BTRACE_MAX_RECORD 20 // three varints of at most 5, 5 and 10 bytes
+
+static const char btrace_magic[4] = {'R', 'V', 'B', 'T'};
+
+static inline uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+
+static inline int32_t unzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+static inline unsigned int btrace_slot(uint32_t pc) { return (pc >> 2) & (BTRACE_SLOTS - 1); }
+
+static inline unsigned char *put_varint(unsigned char *p, uint64_t v) {
+  while (v >= 0x80) {
+    *p++ = (unsigned char)v | 0x80;
+    v >>= 7;
+  }
+  *p++ = (unsigned char)v;
+  return p;
+}
+
+static void btrace_flush(struct btrace_writer *w) {
+  if (fwrite(w->buffer, 1, w->fill, w->file) != w->fill)
+    w->failed = 1;
+  w->fill = 0;
+}
+
+struct btrace_writer *btrace_create(const char *name) {
+  FILE *file = fopen(name, "wb");
+  if (file == NULL)
+    return NULL;
+  struct btrace_writer *w = calloc(1, sizeof(struct btrace_writer));
+  w->file = file;
+  memcpy(w->buffer, btrace_magic, sizeof(btrace_magic));
+  w->buffer[sizeof(btrace_magic)] = BTRACE_VERSION;
+  w->fill = sizeof(btrace_magic) + 1;
+  return w;
+}
+
+void btrace_write(struct btrace_writer *w, uint32_t pc, uint32_t target, int taken,
+                  uint64_t insns) {
+  if (w->fill + BTRACE_MAX_RECORD > sizeof(w->buffer))
+    btrace_flush(w);
+  struct btrace_slot *slot = &w->slots[btrace_slot(pc)];
+  int known = slot->pc == pc && slot->target == target;
+  unsigned char *p = w->buffer + w->fill;
+  p = put_varint(p, (uint64_t)zigzag(pc - w->last_pc) << 2 | known << 1 | (taken != 0));
+  if (!known) {
+    p = put_varint(p, zigzag(target - pc));
+    slot->pc = pc;
+    slot->target = target;
+  }
+  p = put_varint(p, insns - w->last_insns);
+  w->fill = p - w->buffer;
+  w->last_pc = pc;
+  w->last_insns = insns;
+  w->records++;
+}
+
+long int btrace_close(struct btrace_writer *w) {
+  btrace_flush(w);
+  int ok = !w->failed & (fclose(w->file) == 0);
+  long int records = ok ? w->records : -1;
+  free(w);
+  return records;
+}
+
+struct btrace_reader *btrace_open(const char *name) {
+  FILE *file = fopen(name, "rb");
+  if (file == NULL)
+    return NULL;
+  unsigned char header[sizeof(btrace_magic) + 1];
+  if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+      memcmp(header, btrace_magic, sizeof(btrace_magic)) ||
+      header[sizeof(btrace_magic)] != BTRACE_VERSION) {
+    fclose(file);
+    return NULL;
+  }
+  struct btrace_reader *r = calloc(1, sizeof(struct btrace_reader));
+  r->file = file;
+  return r;
+}
+
+// Next byte of the trace, EOF at its end. The reader decodes from its own buffer, refilled a
+// block at a time.
+static int get_byte(struct btrace_reader *r) {
+  if (r->next == r->fill) {
+    r->fill = fread(r->buffer, 1, sizeof(r->buffer), r->file);
+    r->next = 0;
+    if (r->fill == 0)
+      return EOF;
+  }
+  return r->buffer[r->next++];
+}
+
+// Read one varint, 0 at end of file or on a truncated value
+static int get_varint(struct btrace_reader *r, uint64_t *v) {
+  *v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = get_byte(r);
+    if (c == EOF)
+      return 0;
+    *v |= (uint64_t)(c & 0x7f) << shift;
+    if (!(c & 0x80))
+      return 1;
+  }
+  return 0;
+}
+
+int btrace_read(struct btrace_reader *r, struct btrace_record *rec) {
+  uint64_t head, offset, insns;
+  if (!get_varint(r, &head))
+    return 0;
+  uint32_t pc = r->last.pc + unzigzag((uint32_t)(head >> 2));
+  struct btrace_slot *slot = &r->slots[btrace_slot(pc)];
+  if (!(head & 2)) {
+    if (!get_varint(r, &offset))
+      return 0;
+    slot->pc = pc;
+    slot->target = pc + unzigzag((uint32_t)offset);
+  }
+  if (!get_varint(r, &insns))
+    return 0;
+  r->last.pc = pc;
+  r->last.target = slot->target;
+  r->last.taken = head & 1;
+  r->last.insns += insns;
+  *rec = r->last;
+  return 1;
+}
+
+void btrace_reader_close(struct btrace_reader *r) {
+  fclose(r->file);
+  free(r);
+}
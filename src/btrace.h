@@ -0,0 +1,65 @@
+#ifndef __BTRACE_H__
+#define __BTRACE_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Compact binary trace of conditional branches, written while simulating and read back to
+// evaluate predictors without re-executing the program.
+//
+// The file starts with the magic "RVBT" and a version byte, followed by one record per branch.
+// Records are LEB128 varints:
+//   zigzag(pc - previous pc) << 2 | target known << 1 | taken
+//   zigzag(target - pc)              only when the target is not known
+//   instructions since the previous branch, this one included
+// A target is known when the branch last seen in the same slot of a small direct-mapped table
+// (indexed by pc) had the same pc and target, so loops cost two or three bytes per branch.
+
+#define BTRACE_SLOTS 256
+
+struct btrace_record {
+  uint32_t pc;     // address of the branch itself
+  uint32_t target; // address jumped to when taken
+  int taken;
+  uint64_t insns;  // instructions executed up to and including the branch
+};
+
+struct btrace_slot {
+  uint32_t pc;
+  uint32_t target;
+};
+
+struct btrace_writer {
+  FILE *file;
+  uint32_t last_pc;
+  uint64_t last_insns;
+  long int records;
+  int failed; // a flush has failed; reported by btrace_close
+  size_t fill;
+  struct btrace_slot slots[BTRACE_SLOTS];
+  unsigned char buffer[1 << 16];
+};
+
+struct btrace_reader {
+  FILE *file;
+  struct btrace_record last;
+  size_t fill; // bytes in buffer
+  size_t next; // next byte to decode
+  struct btrace_slot slots[BTRACE_SLOTS];
+  unsigned char buffer[1 << 16];
+};
+
+// Writer. Returns NULL if the file cannot be created.
+struct btrace_writer *btrace_create(const char *name);
+void btrace_write(struct btrace_writer *w, uint32_t pc, uint32_t target, int taken,
+                  uint64_t insns);
+// Flush, close and free. Returns the number of records written, -1 on a write error.
+long int btrace_close(struct btrace_writer *w);
+
+// Reader. Returns NULL if the file is missing or not a branch trace.
+struct btrace_reader *btrace_open(const char *name);
+// Fill in the next record, 0 at the end of the trace
+int btrace_read(struct btrace_reader *r, struct btrace_record *rec);
+void btrace_reader_close(struct btrace_reader *r);
+
+#endif
@@ -1,15 +1,12 @@
+#ifndef __COMMON_H__
+#define __COMMON_H__
+
 #include "disassemble.h"
 #include "memory.h"
 #include "simulate.h"
 #include <stdint.h>
 #include <stdio.h>
 
-// ABI names ordered
-static const char *reg_names[32] = {"zero", "ra", "sp",  "gp",  "tp", "t0", "t1", "t2",
-                                    "s0",   "s1", "a0",  "a1",  "a2", "a3", "a4", "a5",
-                                    "a6",   "a7", "s2",  "s3",  "s4", "s5", "s6", "s7",
-                                    "s8",   "s9", "s10", "s11", "t3", "t4", "t5", "t6"};
-
 struct CPU
 {
   uint32_t registers[32];
@@ -29,7 +26,42 @@ typedef struct
   int32_t imm;
 } rv_fields_t;
 
-static void decode_r(uint32_t inst, rv_fields_t *f)
+struct Stat;
+
+// Executes a decoded instruction, advances the pc and returns the log flag
+typedef int (*insn_handler_t)(const rv_fields_t *f, struct Stat *stat);
+
+// Flat operation numbers for the dispatch engines that do not go through the handlers.
+// OP_GENERIC covers every encoding the interpreter treats specially; it runs the handler.
+enum rv_op
+{
+  OP_GENERIC, OP_NOP,
+  OP_ADD, OP_SUB, OP_XOR, OP_OR, OP_AND, OP_SLL, OP_SRL, OP_SRA, OP_SLT, OP_SLTU,
+  OP_MUL, OP_MULH, OP_MULSU, OP_MULU, OP_DIV, OP_DIVU, OP_REM, OP_REMU,
+  OP_ADDI, OP_XORI, OP_ORI, OP_ANDI, OP_SLLI, OP_SRLI, OP_SLTI, OP_SLTIU,
+  OP_LB, OP_LH, OP_LW, OP_LBU, OP_LHU, OP_SB, OP_SH, OP_SW, OP_LUI, OP_AUIPC,
+  OP_BEQ, OP_BNE, OP_BLT, OP_BGE, OP_BLTU, OP_BGEU, OP_JAL, OP_JALR, OP_ECALL,
+  NUM_OPS
+};
+
+// An instruction decoded once and kept in the instruction cache
+struct decoded_insn
+{
+  rv_fields_t fields;
+  insn_handler_t handler;
+  uint32_t raw;
+  enum rv_op op;
+};
+
+// Compact form of a decoded instruction used inside translated blocks
+struct micro_op
+{
+  uint8_t op;
+  uint8_t rd, rs1, rs2;
+  int32_t imm;
+};
+
+static inline void decode_r(uint32_t inst, rv_fields_t *f)
 {
   f->opcode = inst & 0x7F;
   f->rd = (inst >> 7) & 0x1F;
@@ -39,7 +71,7 @@ static void decode_r(uint32_t inst, rv_fields_t *f)
   f->funct7 = (inst >> 25) & 0x7F;
 }
 
-static void decode_i(uint32_t inst, rv_fields_t *f)
+static inline void decode_i(uint32_t inst, rv_fields_t *f)
 {
   f->opcode = inst & 0x7F;
   f->rd = (inst >> 7) & 0x1F;
@@ -51,7 +83,7 @@ static void decode_i(uint32_t inst, rv_fields_t *f)
   f->imm = imm12;
 }
 
-static void decode_s(uint32_t inst, rv_fields_t *f)
+static inline void decode_s(uint32_t inst, rv_fields_t *f)
 {
   f->opcode = inst & 0x7F;
   f->funct3 = (inst >> 12) & 0x07;
@@ -62,7 +94,7 @@ static void decode_s(uint32_t inst, rv_fields_t *f)
   f->imm = imm;
 }
 
-static void decode_b(uint32_t inst, rv_fields_t *f)
+static inline void decode_b(uint32_t inst, rv_fields_t *f)
 {
   f->opcode = inst & 0x7F;
   f->funct3 = (inst >> 12) & 0x07;
@@ -86,14 +118,14 @@ static void decode_b(uint32_t inst, rv_fields_t *f)
   f->imm = buf_imm;  
 }
 
-static void decode_u(uint32_t inst, rv_fields_t *f)
+static inline void decode_u(uint32_t inst, rv_fields_t *f)
 {
   f->opcode = inst & 0x7F;
   f->rd = (inst >> 7) & 0x1F;
   f->imm = ((inst >> 12) & 0xFFFFF);
 }
 
-static void decode_j(uint32_t inst, rv_fields_t *f)
+static inline void decode_j(uint32_t inst, rv_fields_t *f)
 {
   f->opcode = inst & 0x7F;
   f->rd = (inst >> 7) & 0x1F;
@@ -113,3 +145,5 @@ static void decode_j(uint32_t inst, rv_fields_t *f)
   buf_imm = (buf_imm << 11) >> 11;
   f->imm = buf_imm;
 }
+
+#endif
@@ -3,6 +3,14 @@
 #include "memory.h"
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ABI names ordered
+static const char *reg_names[32] = {"zero", "ra", "sp",  "gp",  "tp", "t0", "t1", "t2",
+                                    "s0",   "s1", "a0",  "a1",  "a2", "a3", "a4", "a5",
+                                    "a6",   "a7", "s2",  "s3",  "s4", "s5", "s6", "s7",
+                                    "s8",   "s9", "s10", "s11", "t3", "t4", "t5", "t6"};
 
 // Disassembler for R-type instruktioner (opcode = 0x33).
 static void disas_r_type(char *result, size_t buf_size, uint32_t rd, uint32_t rs1, uint32_t rs2,
@@ -276,3 +284,70 @@ void disassemble(uint32_t addr, uint32_t instruction, char *result, size_t buf_s
   }
   }
 }
+
+#define DISASM_CACHE_CAPACITY 4096
+#define DISASM_CACHE_ARENA 65536
+#define DISASM_TEXT_SIZE 120 // the largest buffer a caller gives disassemble()
+
+struct disasm_cache *disasm_cache_create(void) {
+  struct disasm_cache *cache = malloc(sizeof(struct disasm_cache));
+  cache->capacity = DISASM_CACHE_CAPACITY;
+  cache->used = 0;
+  cache->entries = calloc(cache->capacity, sizeof(struct disasm_entry));
+  cache->arena_size = DISASM_CACHE_ARENA;
+  cache->arena = malloc(cache->arena_size);
+  cache->arena[0] = '\0';
+  cache->arena_fill = 1; // offset 0 marks empty slots
+  return cache;
+}
+
+void disasm_cache_delete(struct disasm_cache *cache) {
+  free(cache->entries);
+  free(cache->arena);
+  free(cache);
+}
+
+static struct disasm_entry *disasm_cache_slot(struct disasm_cache *cache, uint32_t instruction) {
+  unsigned int mask = cache->capacity - 1;
+  unsigned int slot = (instruction * 0x9e3779b1u) >> 12 & mask;
+  while (cache->entries[slot].offset && cache->entries[slot].instruction != instruction)
+    slot = (slot + 1) & mask;
+  return &cache->entries[slot];
+}
+
+static void disasm_cache_grow(struct disasm_cache *cache) {
+  struct disasm_entry *old = cache->entries;
+  unsigned int old_capacity = cache->capacity;
+  cache->capacity *= 2;
+  cache->entries = calloc(cache->capacity, sizeof(struct disasm_entry));
+  for (unsigned int i = 0; i < old_capacity; i++)
+    if (old[i].offset)
+      *disasm_cache_slot(cache, old[i].instruction) = old[i];
+  free(old);
+}
+
+const char *disasm_cache_lookup(struct disasm_cache *cache, uint32_t addr, uint32_t instruction,
+                                size_t *length) {
+  struct disasm_entry *e = disasm_cache_slot(cache, instruction);
+  if (!e->offset) {
+    if (2 * (cache->used + 1) > cache->capacity) {
+      disasm_cache_grow(cache);
+      return disasm_cache_lookup(cache, addr, instruction, length);
+    }
+    if (cache->arena_size - cache->arena_fill < DISASM_TEXT_SIZE) {
+      cache->arena_size *= 2;
+      cache->arena = realloc(cache->arena, cache->arena_size);
+    }
+    // Every known opcode writes a mnemonic, so text left empty means an unknown word
+    char *text = cache->arena + cache->arena_fill;
+    text[0] = '\0';
+    disassemble(addr, instruction, text, DISASM_TEXT_SIZE);
+    e->instruction = instruction;
+    e->offset = cache->arena_fill;
+    e->length = strlen(text);
+    cache->arena_fill += e->length + 1;
+    cache->used++;
+  }
+  *length = e->length;
+  return e->length ? cache->arena + e->offset : NULL;
+}
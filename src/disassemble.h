@@ -1,3 +1,6 @@
+#ifndef __DISASSEMBLE_H__
+#define __DISASSEMBLE_H__
+
 
 #include <stddef.h>
 #include <stdint.h>
@@ -7,3 +10,33 @@
 
 struct symbols;
 void disassemble(uint32_t addr, uint32_t instruction, char* result, size_t buf_size);
+
+// Memoized disassembly. disassemble() only looks at the instruction word, so the rendered text
+// is cached per word: an open-addressing table of (word, offset, length) into one growing
+// arena of NUL-terminated strings. A program has a few thousand distinct words, so after
+// warm-up every lookup is a probe and a pointer into the arena.
+
+struct disasm_entry {
+  uint32_t instruction;
+  uint32_t offset; // into the arena, 0 for an empty slot
+  uint32_t length; // 0 when disassemble() leaves the buffer untouched (unknown opcode)
+};
+
+struct disasm_cache {
+  unsigned int capacity; // power of two
+  unsigned int used;
+  struct disasm_entry *entries;
+  char *arena;
+  size_t arena_size;
+  size_t arena_fill;
+};
+
+struct disasm_cache *disasm_cache_create(void);
+void disasm_cache_delete(struct disasm_cache *cache);
+
+// The text disassemble() writes for the instruction, with its length, or NULL for words it
+// does not render. The pointer is valid until the next lookup.
+const char *disasm_cache_lookup(struct disasm_cache *cache, uint32_t addr, uint32_t instruction,
+                                size_t *length);
+
+#endif
@@ -0,0 +1,161 @@
+#include "eprofile.h"
+#include "disassemble.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define EPROFILE_HOT_INSNS 20 // instructions listed after the functions
+
+struct eprofile *eprofile_create(uint32_t text_start, uint32_t text_end) {
+  struct eprofile *profile = malloc(sizeof(struct eprofile));
+  profile->text_start = text_start;
+  profile->size = text_end > text_start ? (text_end - text_start) >> 2 : 0;
+  profile->counts = calloc(profile->size ? profile->size : 1, sizeof(long int));
+  return profile;
+}
+
+void eprofile_delete(struct eprofile *profile) {
+  free(profile->counts);
+  free(profile);
+}
+
+void eprofile_reset(struct eprofile *profile) {
+  memset(profile->counts, 0, profile->size * sizeof(long int));
+}
+
+struct eprofile_function {
+  const char *name;
+  uint32_t start;
+  long int count;
+};
+
+// Split the text segment into functions in address order and total their counts. A sized
+// function symbol covers its range; elsewhere a new function starts at each bound symbol.
+static struct eprofile_function *eprofile_functions(struct eprofile *profile,
+                                                    struct symbols *symbols, unsigned int *num) {
+  struct eprofile_function *functions =
+      malloc((profile->size + 1) * sizeof(struct eprofile_function));
+  unsigned int count = 0;
+  const char *current = NULL;
+  for (uint32_t i = 0; i < profile->size; i++) {
+    uint32_t pc = profile->text_start + 4 * i;
+    const char *name = NULL;
+    if (symbols) {
+      unsigned int offset;
+      name = symbols_addr_to_func(symbols, pc, &offset);
+      if (name == NULL)
+        name = symbols_value_to_sym(symbols, pc);
+    }
+    if (count == 0 || (name && name != current)) {
+      functions[count].name = name ? name : "?";
+      functions[count].start = pc;
+      functions[count].count = 0;
+      count++;
+      current = name;
+    }
+    functions[count - 1].count += profile->counts[i];
+  }
+  *num = count;
+  return functions;
+}
+
+// The function holding pc: the last one starting at or below it
+static const struct eprofile_function *eprofile_function_at(
+    const struct eprofile_function *functions, unsigned int num, uint32_t pc) {
+  unsigned int low = 0, high = num;
+  while (low < high) {
+    unsigned int mid = low + (high - low) / 2;
+    if (functions[mid].start <= pc)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return &functions[low - 1];
+}
+
+// Most executed first, ties by address
+static int eprofile_compare_functions(const void *a, const void *b) {
+  const struct eprofile_function *x = a;
+  const struct eprofile_function *y = b;
+  if (x->count != y->count)
+    return x->count < y->count ? 1 : -1;
+  return (x->start > y->start) - (x->start < y->start);
+}
+
+struct eprofile_rank {
+  uint32_t pc;
+  long int count;
+};
+
+static int eprofile_compare_ranks(const void *a, const void *b) {
+  const struct eprofile_rank *x = a;
+  const struct eprofile_rank *y = b;
+  if (x->count != y->count)
+    return x->count < y->count ? 1 : -1;
+  return (x->pc > y->pc) - (x->pc < y->pc);
+}
+
+void eprofile_print(struct eprofile *profile, struct symbols *symbols, struct memory *mem,
+                    FILE *out) {
+  if (profile->size == 0)
+    return;
+  long int total = 0;
+  unsigned int executed = 0;
+  for (uint32_t i = 0; i < profile->size; i++) {
+    total += profile->counts[i];
+    executed += profile->counts[i] != 0;
+  }
+  double scale = total ? 100.0 / total : 0.0;
+
+  unsigned int num;
+  struct eprofile_function *functions = eprofile_functions(profile, symbols, &num);
+  struct eprofile_function *ranked = malloc(num * sizeof(struct eprofile_function));
+  memcpy(ranked, functions, num * sizeof(struct eprofile_function));
+  qsort(ranked, num, sizeof(struct eprofile_function), eprofile_compare_functions);
+  fprintf(out, "Execution profile: %ld instructions in the text segment, %u of %u executed\n",
+          total, executed, profile->size);
+  fprintf(out, "\n%14s %7s  %-8s  %s\n", "instructions", "share", "address", "function");
+  for (unsigned int f = 0; f < num && ranked[f].count; f++)
+    fprintf(out, "%14ld %6.1f%%  %8x  %s\n", ranked[f].count, scale * ranked[f].count,
+            ranked[f].start, ranked[f].name);
+  free(ranked);
+
+  struct eprofile_rank *ranks = malloc((executed + 1) * sizeof(struct eprofile_rank));
+  unsigned int count = 0;
+  for (uint32_t i = 0; i < profile->size; i++) {
+    if (profile->counts[i] == 0)
+      continue;
+    ranks[count].pc = profile->text_start + 4 * i;
+    ranks[count].count = profile->counts[i];
+    count++;
+  }
+  qsort(ranks, count, sizeof(struct eprofile_rank), eprofile_compare_ranks);
+  if (count > EPROFILE_HOT_INSNS)
+    count = EPROFILE_HOT_INSNS;
+  fprintf(out, "\nHottest instructions\n");
+  fprintf(out, "%8s  %-28s %14s %7s  %s\n", "pc", "location", "executions", "share",
+          "instruction");
+  struct disasm_cache *cache = disasm_cache_create();
+  for (unsigned int r = 0; r < count; r++) {
+    const struct eprofile_function *f = eprofile_function_at(functions, num, ranks[r].pc);
+    char location[64];
+    snprintf(location, sizeof(location), "%s+%u", f->name, ranks[r].pc - f->start);
+    size_t length;
+    const char *text =
+        disasm_cache_lookup(cache, ranks[r].pc, memory_rd_w(mem, ranks[r].pc), &length);
+    fprintf(out, "%8x  %-28s %14ld %6.1f%%  %s\n", ranks[r].pc, location, ranks[r].count,
+            scale * ranks[r].count, text ? text : "?");
+  }
+  disasm_cache_delete(cache);
+  free(ranks);
+  free(functions);
+}
+
+void eprofile_print_collapsed(struct eprofile *profile, struct symbols *symbols, FILE *out) {
+  unsigned int num;
+  struct eprofile_function *functions = eprofile_functions(profile, symbols, &num);
+  for (unsigned int f = 0; f < num; f++) {
+    if (functions[f].count)
+      fprintf(out, "%s %ld\n", functions[f].name, functions[f].count);
+  }
+  free(functions);
+}
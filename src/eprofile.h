@@ -0,0 +1,50 @@
+#ifndef __EPROFILE_H__
+#define __EPROFILE_H__
+
+#include "memory.h"
+#include "read_elf.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// Execution profile (-p): one counter per instruction word of the text segment, indexed by
+// (pc - text_start) >> 2. The switch engine bumps the counter of every instruction it runs; the
+// block engines count block executions and spread them over the block's instructions with
+// eprofile_add_range() when they finish. Functions are only looked up when the report is
+// written.
+
+struct eprofile {
+  uint32_t text_start;
+  uint32_t size; // instruction words in the text segment
+  long int *counts;
+};
+
+struct eprofile *eprofile_create(uint32_t text_start, uint32_t text_end);
+void eprofile_delete(struct eprofile *profile);
+void eprofile_reset(struct eprofile *profile);
+
+// Count one execution of the instruction at pc; code outside the text segment is not profiled
+static inline void eprofile_count(struct eprofile *profile, uint32_t pc) {
+  uint32_t index = (pc - profile->text_start) >> 2;
+  if (index < profile->size)
+    profile->counts[index]++;
+}
+
+// Add executions to each of the len instructions from pc on
+static inline void eprofile_add_range(struct eprofile *profile, uint32_t pc, uint32_t len,
+                                      long int executions) {
+  uint32_t index = (pc - profile->text_start) >> 2;
+  for (uint32_t i = 0; i < len && index + i < profile->size; i++)
+    profile->counts[index + i] += executions;
+}
+
+// Flat report: instructions per function, most executed first, then the hottest instructions
+// with their disassembly. Functions come from the symbol table; code no sized function covers
+// belongs to the nearest symbol before it.
+void eprofile_print(struct eprofile *profile, struct symbols *symbols, struct memory *mem,
+                    FILE *out);
+
+// The same per-function totals as "function count" lines in the collapsed-stack format that
+// flame graph tools read. The profile has no call stacks, so every stack is one frame deep.
+void eprofile_print_collapsed(struct eprofile *profile, struct symbols *symbols, FILE *out);
+
+#endif
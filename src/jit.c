@@ -0,0 +1,391 @@
+#include "jit.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// The code buffer is never writable and executable at once: it is mapped read/write, and the
+// pages of each block are made read/execute once the block is emitted. A later block sharing
+// the last page flips it back to writable while it is emitted; no native code runs meanwhile.
+//
+// Generated code keeps the guest register file in rbx, the memory in r12 and the stats in r13.
+// Every guest operation loads its sources from the register file into eax/ecx/edx, computes
+// and stores the result back, so nothing is live across the calls into the memory module.
+
+#define JIT_BUFFER_SIZE (16 * 1024 * 1024)
+#define JIT_MAX_BLOCK_CODE 4096 // upper bound on the code for one block
+
+enum { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSI = 6, RDI = 7 };
+
+static uint8_t *code_buffer = NULL;
+static size_t code_used = 0;
+static jit_branch_hook_t branch_hook = NULL;
+static uint8_t *emit_ptr;
+
+static void emit8(uint8_t b) { *emit_ptr++ = b; }
+
+static void emit32(uint32_t v) {
+  memcpy(emit_ptr, &v, 4);
+  emit_ptr += 4;
+}
+
+static void emit64(uint64_t v) {
+  memcpy(emit_ptr, &v, 8);
+  emit_ptr += 8;
+}
+
+// mov r32, [rbx + 4 * guest]
+static void emit_load_reg(int host, int guest) {
+  emit8(0x8B);
+  emit8(0x43 | (host << 3));
+  emit8(guest * 4);
+}
+
+// mov [rbx + 4 * guest], r32
+static void emit_store_reg(int host, int guest) {
+  emit8(0x89);
+  emit8(0x43 | (host << 3));
+  emit8(guest * 4);
+}
+
+// mov dword [rbx + 4 * guest], imm32
+static void emit_store_imm(int guest, uint32_t imm) {
+  emit8(0xC7);
+  emit8(0x43);
+  emit8(guest * 4);
+  emit32(imm);
+}
+
+// mov r32, imm32
+static void emit_mov_imm(int host, uint32_t imm) {
+  emit8(0xB8 + host);
+  emit32(imm);
+}
+
+// <alu> eax, ecx for the 0x01-style opcodes (add, or, and, sub, xor, cmp)
+static void emit_alu_eax_ecx(uint8_t opcode) {
+  emit8(opcode);
+  emit8(0xC0 | (RCX << 3) | RAX);
+}
+
+// <alu> r32, imm32 with the /n extension (0 add, 1 or, 4 and, 5 sub, 6 xor, 7 cmp)
+static void emit_alu_imm(int ext, int host, uint32_t imm) {
+  emit8(0x81);
+  emit8(0xC0 | (ext << 3) | host);
+  emit32(imm);
+}
+
+// setcc al; movzx eax, al
+static void emit_setcc_eax(uint8_t cc) {
+  emit8(0x0F);
+  emit8(cc);
+  emit8(0xC0);
+  emit8(0x0F);
+  emit8(0xB6);
+  emit8(0xC0);
+}
+
+// mov rax, target; call rax
+static void emit_call(uintptr_t target) {
+  emit8(0x48);
+  emit8(0xB8);
+  emit64(target);
+  emit8(0xFF);
+  emit8(0xD0);
+}
+
+static void emit_prologue(void) {
+  emit8(0x53);                          // push rbx
+  emit8(0x41), emit8(0x54);             // push r12
+  emit8(0x41), emit8(0x55);             // push r13
+  emit8(0x48), emit8(0x89), emit8(0xFB); // mov rbx, rdi
+  emit8(0x49), emit8(0x89), emit8(0xF4); // mov r12, rsi
+  emit8(0x49), emit8(0x89), emit8(0xD5); // mov r13, rdx
+}
+
+// Return the next pc, already in eax
+static void emit_epilogue(void) {
+  emit8(0x41), emit8(0x5D); // pop r13
+  emit8(0x41), emit8(0x5C); // pop r12
+  emit8(0x5B);              // pop rbx
+  emit8(0xC3);              // ret
+}
+
+// Register-register ALU op computing eax = rs1 <op> rs2 into rd
+static void emit_r_alu(const struct micro_op *u, uint8_t opcode) {
+  emit_load_reg(RAX, u->rs1);
+  emit_load_reg(RCX, u->rs2);
+  emit_alu_eax_ecx(opcode);
+  emit_store_reg(RAX, u->rd);
+}
+
+// Shift of eax by cl (/4 shl, /5 shr, /7 sar)
+static void emit_r_shift(const struct micro_op *u, int ext) {
+  emit_load_reg(RAX, u->rs1);
+  emit_load_reg(RCX, u->rs2);
+  emit8(0xD3);
+  emit8(0xC0 | (ext << 3) | RAX);
+  emit_store_reg(RAX, u->rd);
+}
+
+static void emit_r_compare(const struct micro_op *u, uint8_t cc) {
+  emit_load_reg(RAX, u->rs1);
+  emit_load_reg(RCX, u->rs2);
+  emit_alu_eax_ecx(0x39); // cmp eax, ecx
+  emit_setcc_eax(cc);
+  emit_store_reg(RAX, u->rd);
+}
+
+// High word of the 64-bit product. The interpreter widens both operands from uint32_t, so all
+// three mulh variants compute the unsigned high word.
+static void emit_mul_high(const struct micro_op *u) {
+  emit_load_reg(RAX, u->rs1);
+  emit_load_reg(RCX, u->rs2);
+  emit8(0x48), emit8(0x0F), emit8(0xAF), emit8(0xC1); // imul rax, rcx
+  emit8(0x48), emit8(0xC1), emit8(0xE8), emit8(0x20); // shr rax, 32
+  emit_store_reg(RAX, u->rd);
+}
+
+// Division leaving quotient in eax and remainder in edx. Traps on zero like the interpreter.
+static void emit_divide(const struct micro_op *u, int is_signed, int result) {
+  emit_load_reg(RAX, u->rs1);
+  if (is_signed) {
+    emit8(0x99); // cdq
+    emit8(0xF7), emit8(0x7B), emit8(u->rs2 * 4); // idiv dword [rbx + rs2]
+  } else {
+    emit8(0x31), emit8(0xD2); // xor edx, edx
+    emit8(0xF7), emit8(0x73), emit8(u->rs2 * 4); // div dword [rbx + rs2]
+  }
+  emit_store_reg(result, u->rd);
+}
+
+static void emit_i_alu(const struct micro_op *u, int ext) {
+  emit_load_reg(RAX, u->rs1);
+  emit_alu_imm(ext, RAX, u->imm);
+  emit_store_reg(RAX, u->rd);
+}
+
+// Shift of eax by an immediate (/4 shl, /5 shr); the host masks the count like the interpreter
+static void emit_i_shift(const struct micro_op *u, int ext) {
+  emit_load_reg(RAX, u->rs1);
+  emit8(0xC1);
+  emit8(0xC0 | (ext << 3) | RAX);
+  emit8(u->imm & 0xFF);
+  emit_store_reg(RAX, u->rd);
+}
+
+static void emit_i_compare(const struct micro_op *u, uint8_t cc) {
+  emit_load_reg(RAX, u->rs1);
+  emit_alu_imm(7, RAX, u->imm); // cmp eax, imm32
+  emit_setcc_eax(cc);
+  emit_store_reg(RAX, u->rd);
+}
+
+// rdi = memory, esi = rs1 + imm
+static void emit_address_args(const struct micro_op *u) {
+  emit8(0x4C), emit8(0x89), emit8(0xE7); // mov rdi, r12
+  emit_load_reg(RSI, u->rs1);
+  emit_alu_imm(0, RSI, u->imm);
+}
+
+// Call the memory read and extend the result with the given 0F xx opcode (0 for none)
+static void emit_load(const struct micro_op *u, int (*read)(struct memory *, int), uint8_t ext) {
+  emit_address_args(u);
+  emit_call((uintptr_t)read);
+  if (ext) {
+    emit8(0x0F);
+    emit8(ext);
+    emit8(0xC0);
+  }
+  emit_store_reg(RAX, u->rd);
+}
+
+static void emit_store(const struct micro_op *u, void (*write)(struct memory *, int, int),
+                       uint8_t ext) {
+  emit_address_args(u);
+  emit_load_reg(RDX, u->rs2);
+  if (ext) {
+    emit8(0x0F);
+    emit8(ext);
+    emit8(0xD2);
+  }
+  emit_call((uintptr_t)write);
+}
+
+static int emit_body_op(const struct micro_op *u) {
+  switch (u->op) {
+  case OP_NOP: return 1;
+  case OP_ADD: emit_r_alu(u, 0x01); return 1;
+  case OP_SUB: emit_r_alu(u, 0x29); return 1;
+  case OP_XOR: emit_r_alu(u, 0x31); return 1;
+  case OP_OR: emit_r_alu(u, 0x09); return 1;
+  case OP_AND: emit_r_alu(u, 0x21); return 1;
+  case OP_SLL: emit_r_shift(u, 4); return 1;
+  case OP_SRL: emit_r_shift(u, 5); return 1;
+  case OP_SRA: emit_r_shift(u, 7); return 1;
+  case OP_SLT: emit_r_compare(u, 0x9C); return 1;  // setl
+  case OP_SLTU: emit_r_compare(u, 0x92); return 1; // setb
+  case OP_MUL:
+    emit_load_reg(RAX, u->rs1);
+    emit_load_reg(RCX, u->rs2);
+    emit8(0x0F), emit8(0xAF), emit8(0xC1); // imul eax, ecx
+    emit_store_reg(RAX, u->rd);
+    return 1;
+  case OP_MULH:
+  case OP_MULSU:
+  case OP_MULU: emit_mul_high(u); return 1;
+  case OP_DIV: emit_divide(u, 1, RAX); return 1;
+  case OP_DIVU: emit_divide(u, 0, RAX); return 1;
+  case OP_REM: emit_divide(u, 1, RDX); return 1;
+  case OP_REMU: emit_divide(u, 0, RDX); return 1;
+  case OP_ADDI: emit_i_alu(u, 0); return 1;
+  case OP_ORI: emit_i_alu(u, 1); return 1;
+  case OP_ANDI: emit_i_alu(u, 4); return 1;
+  case OP_XORI: emit_i_alu(u, 6); return 1;
+  case OP_SLLI: emit_i_shift(u, 4); return 1;
+  case OP_SRLI: emit_i_shift(u, 5); return 1;
+  case OP_SLTI: emit_i_compare(u, 0x9C); return 1;
+  case OP_SLTIU: emit_i_compare(u, 0x92); return 1;
+  case OP_LB: emit_load(u, memory_rd_b, 0xBE); return 1;  // movsx eax, al
+  case OP_LH: emit_load(u, memory_rd_h, 0xBF); return 1;  // movsx eax, ax
+  case OP_LW: emit_load(u, memory_rd_w, 0); return 1;
+  case OP_LBU: emit_load(u, memory_rd_b, 0xB6); return 1; // movzx eax, al
+  case OP_LHU: emit_load(u, memory_rd_h, 0xB7); return 1; // movzx eax, ax
+  case OP_SB: emit_store(u, memory_wr_b, 0xB6); return 1; // movzx edx, dl
+  case OP_SH: emit_store(u, memory_wr_h, 0xB7); return 1; // movzx edx, dx
+  case OP_SW: emit_store(u, memory_wr_w, 0); return 1;
+  case OP_LUI: emit_store_imm(u->rd, (uint32_t)u->imm << 12); return 1;
+  case OP_AUIPC: emit_store_imm(u->rd, u->imm); return 1; // pc folded in at translation
+  default: return 0;
+  }
+}
+
+// Branch: taken flag in ecx, then let the hook account for it and pick the next pc
+static void emit_branch(const struct micro_op *u, uint32_t pc, uint8_t cc) {
+  emit_load_reg(RAX, u->rs1);
+  emit_load_reg(RCX, u->rs2);
+  emit_alu_eax_ecx(0x39); // cmp eax, ecx
+  emit8(0x0F), emit8(cc), emit8(0xC1);    // setcc cl
+  emit8(0x0F), emit8(0xB6), emit8(0xC9);  // movzx ecx, cl
+  emit8(0x4C), emit8(0x89), emit8(0xEF);  // mov rdi, r13
+  emit_mov_imm(RSI, pc);
+  emit_mov_imm(RDX, u->imm);
+  emit_call((uintptr_t)branch_hook);
+}
+
+static int emit_terminator(const struct micro_op *u, uint32_t pc) {
+  switch (u->op) {
+  case OP_NOP: emit_mov_imm(RAX, pc); return 1;
+  case OP_BEQ: emit_branch(u, pc, 0x94); return 1;  // sete
+  case OP_BNE: emit_branch(u, pc, 0x95); return 1;  // setne
+  case OP_BLT: emit_branch(u, pc, 0x9C); return 1;  // setl
+  case OP_BGE: emit_branch(u, pc, 0x9D); return 1;  // setge
+  case OP_BLTU: emit_branch(u, pc, 0x92); return 1; // setb
+  case OP_BGEU: emit_branch(u, pc, 0x93); return 1; // setae
+  case OP_JAL:
+    if (u->rd != 0)
+      emit_store_imm(u->rd, pc + 4);
+    emit_mov_imm(RAX, pc + u->imm);
+    return 1;
+  case OP_JALR:
+    // Same order as the interpreter: the link register is written before rs1 is read
+    if (u->rd != 0)
+      emit_store_imm(u->rd, pc + 4);
+    emit_load_reg(RAX, u->rs1);
+    emit_alu_imm(0, RAX, u->imm);
+    emit_alu_imm(4, RAX, ~1u);
+    return 1;
+  default: return 0;
+  }
+}
+
+int jit_init(jit_branch_hook_t hook) {
+  if (code_buffer == NULL) {
+    void *p = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                   -1, 0);
+    if (p == MAP_FAILED)
+      return 0;
+    code_buffer = p;
+  }
+  code_used = 0;
+  branch_hook = hook;
+  return 1;
+}
+
+void jit_shutdown(void) {
+  if (code_buffer)
+    munmap(code_buffer, JIT_BUFFER_SIZE);
+  code_buffer = NULL;
+  code_used = 0;
+}
+
+// Change the protection of the whole pages holding [from, to)
+static int jit_protect(uint8_t *from, uint8_t *to, int prot) {
+  uintptr_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t first = (uintptr_t)from & ~(page - 1);
+  uintptr_t last = ((uintptr_t)to + page - 1) & ~(page - 1);
+  void *at;
+  memcpy(&at, &first, sizeof(at));
+  return mprotect(at, last - first, prot) == 0;
+}
+
+// Emit the block at emit_ptr; 0 if an operation cannot be compiled
+static int emit_block(const struct micro_op *body, uint32_t num_body,
+                      const struct micro_op *term, uint32_t term_pc) {
+  emit_prologue();
+  for (uint32_t i = 0; i < num_body; i++) {
+    if (!emit_body_op(&body[i]))
+      return 0;
+  }
+  if (term) {
+    if (!emit_terminator(term, term_pc))
+      return 0;
+  } else {
+    emit_mov_imm(RAX, term_pc);
+  }
+  emit_epilogue();
+  return 1;
+}
+
+jit_block_fn jit_compile(const struct micro_op *body, uint32_t num_body,
+                         const struct micro_op *term, uint32_t term_pc) {
+  if (code_buffer == NULL || code_used + JIT_MAX_BLOCK_CODE > JIT_BUFFER_SIZE)
+    return NULL;
+  uint8_t *start = code_buffer + code_used;
+  if (!jit_protect(start, start + JIT_MAX_BLOCK_CODE, PROT_READ | PROT_WRITE))
+    return NULL;
+  emit_ptr = start;
+  int ok = emit_block(body, num_body, term, term_pc);
+  // Earlier blocks on the first page run again, so it goes back to executable either way
+  if (!jit_protect(start, ok ? emit_ptr : start + 1, PROT_READ | PROT_EXEC) || !ok)
+    return NULL;
+  code_used += emit_ptr - start;
+  jit_block_fn fn;
+  memcpy(&fn, &start, sizeof(fn)); // object to function pointer without a pedantic cast
+  return fn;
+}
+
+#else
+
+// Other hosts have no code generator; the block engine keeps interpreting
+
+int jit_init(jit_branch_hook_t hook) {
+  (void)hook;
+  return 0;
+}
+
+void jit_shutdown(void) {}
+
+jit_block_fn jit_compile(const struct micro_op *body, uint32_t num_body,
+                         const struct micro_op *term, uint32_t term_pc) {
+  (void)body;
+  (void)num_body;
+  (void)term;
+  (void)term_pc;
+  return NULL;
+}
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include "common.h"
+#include "memory.h"
+#include "simulate.h"
+#include <stdint.h>
+
+// Native x86-64 translation of hot basic blocks. Compiled code works directly on the guest
+// register file and returns the pc of the next block.
+typedef uint32_t (*jit_block_fn)(uint32_t *regs, struct memory *mem, struct Stat *stat);
+
+// Called by compiled code at every conditional branch. Must do the predictor accounting and
+// return the next pc.
+typedef uint32_t (*jit_branch_hook_t)(struct Stat *stat, uint32_t pc, int32_t imm, int taken);
+
+// Set up the code buffer. Returns 0 if the host cannot run generated code.
+int jit_init(jit_branch_hook_t hook);
+void jit_shutdown(void);
+
+// Compile a block body followed by its terminator at term_pc. A NULL term compiles the body
+// only and returns term_pc, leaving the terminator to the interpreter. Returns NULL when the
+// code buffer is full.
+jit_block_fn jit_compile(const struct micro_op *body, uint32_t num_body,
+                         const struct micro_op *term, uint32_t term_pc);
+
+#endif
@@ -0,0 +1,66 @@
+#include "logwriter.h"
+#include <sched.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define LOG_WRITER_SPINS 64 // empty polls before the consumer starts sleeping
+
+static void *log_writer_run(void *arg) {
+  struct log_writer *w = arg;
+  size_t tail = atomic_load_explicit(&w->tail, memory_order_relaxed);
+  struct disasm_cache *cache = disasm_cache_create();
+  int previous_flag = 0;
+  int idle = 0;
+  for (;;) {
+    size_t head = atomic_load_explicit(&w->head, memory_order_acquire);
+    if (head == tail) {
+      if (atomic_load_explicit(&w->closing, memory_order_acquire) &&
+          atomic_load_explicit(&w->head, memory_order_acquire) == tail)
+        break;
+      // Back off: yield at first, then sleep so an idle writer leaves the cpu alone
+      if (++idle < LOG_WRITER_SPINS) {
+        sched_yield();
+      } else {
+        struct timespec nap = {0, 100000};
+        nanosleep(&nap, NULL);
+      }
+      continue;
+    }
+    idle = 0;
+    for (; tail != head; tail++) {
+      const struct binlog_record *r = &w->ring[tail & (LOG_WRITER_RING - 1)];
+      binlog_render(cache, r, previous_flag, w->out);
+      previous_flag = r->flag;
+      // Hand slots back in batches so the producer sees room without a store per record
+      if ((tail & 1023) == 1023)
+        atomic_store_explicit(&w->tail, tail + 1, memory_order_release);
+    }
+    atomic_store_explicit(&w->tail, tail, memory_order_release);
+  }
+  disasm_cache_delete(cache);
+  return NULL;
+}
+
+struct log_writer *log_writer_start(FILE *out) {
+  struct log_writer *w = malloc(sizeof(struct log_writer));
+  w->out = out;
+  atomic_init(&w->head, 0);
+  atomic_init(&w->tail, 0);
+  atomic_init(&w->closing, 0);
+  if (pthread_create(&w->thread, NULL, log_writer_run, w)) {
+    free(w);
+    return NULL;
+  }
+  return w;
+}
+
+void log_writer_wait_for_room(struct log_writer *w, size_t head) {
+  while (head - atomic_load_explicit(&w->tail, memory_order_acquire) == LOG_WRITER_RING)
+    sched_yield();
+}
+
+void log_writer_finish(struct log_writer *w) {
+  atomic_store_explicit(&w->closing, 1, memory_order_release);
+  pthread_join(w->thread, NULL);
+  free(w);
+}
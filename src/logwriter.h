@@ -0,0 +1,45 @@
+#ifndef __LOGWRITER_H__
+#define __LOGWRITER_H__
+
+#include "binlog.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+// Asynchronous writer for the -l text log. The simulation thread pushes raw records into a
+// single-producer single-consumer ring; a background thread formats them with binlog_render()
+// and writes the text. The simulator only waits when the ring is full.
+
+#define LOG_WRITER_RING 65536 // records, power of two
+
+struct log_writer {
+  FILE *out;
+  pthread_t thread;
+  _Atomic size_t head; // next slot the producer fills
+  _Atomic size_t tail; // next slot the consumer reads
+  _Atomic int closing;
+  struct binlog_record ring[LOG_WRITER_RING];
+};
+
+// Start the writer thread on out. Returns NULL if the thread cannot be started.
+struct log_writer *log_writer_start(FILE *out);
+// Wait until every record is written, stop the thread and free. out stays open.
+void log_writer_finish(struct log_writer *w);
+
+void log_writer_wait_for_room(struct log_writer *w, size_t head);
+
+static inline void log_writer_push(struct log_writer *w, uint64_t insns, uint32_t pc,
+                                   uint32_t raw, uint32_t rd_value, int flag) {
+  size_t head = atomic_load_explicit(&w->head, memory_order_relaxed);
+  if (head - atomic_load_explicit(&w->tail, memory_order_acquire) == LOG_WRITER_RING)
+    log_writer_wait_for_room(w, head);
+  struct binlog_record *r = &w->ring[head & (LOG_WRITER_RING - 1)];
+  r->insns = insns;
+  r->pc = pc;
+  r->raw = raw;
+  r->rd_value = rd_value;
+  r->flag = flag;
+  atomic_store_explicit(&w->head, head + 1, memory_order_release);
+}
+
+#endif
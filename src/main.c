@@ -17,7 +17,28 @@ void terminate(const char *error) {
   printf(
       "      sim riscv-elf -d         // disassemble text segment of riscv-elf file to stdout\n");
   printf("      sim riscv-elf -l log     // simulate and log each instruction to file 'log'\n");
+  printf("      sim riscv-elf -L log     // log each instruction in binary to 'log', see simlog\n");
   printf("      sim riscv-elf -s log     // simulate and log only summary to file 'log'\n");
+  printf("      sim riscv-elf -p prof    // write an execution profile per function to 'prof'\n");
+  printf("                               // and flame graph stacks to 'prof.folded'\n");
+  printf("      sim riscv-elf -t trace   // write a binary branch trace to file 'trace'\n");
+  printf("      sim riscv-elf -o dump    // dump branch outcomes to 'dump' for predsim\n");
+  printf("      sim riscv-elf -e engine  // dispatch engine: switch (default), threaded,\n");
+  printf("                               // block or jit (x86-64 hosts)\n");
+  printf("      sim riscv-elf -m model   // memory model: paged (default) or flat (4 GiB mmap)\n");
+  printf("      sim riscv-elf -b spec    // add a branch predictor, may be repeated. spec is\n");
+  printf("                               // type[:entries=N,history=N,bits=N,max=N,name=S]\n");
+  printf("                               // TAGE also takes tables=N,minhist=N,tagbits=N\n");
+  printf("                               // PERCEPTRON also takes threshold=N\n");
+  printf("                               // default: NT, BTFNT, BIMODAL, GSHARE, TAGE and\n");
+  printf("                               // PERCEPTRON\n");
+  printf("      sim riscv-elf -B spec    // predict jal/jalr targets with BTB and return stack\n");
+  printf("                               // spec is default or sets=N,ways=N,ras=N,\n");
+  printf("                               // repl=lru|fifo|random\n");
+  printf("      sim riscv-elf -H n       // report the n most mispredicted branches\n");
+  printf("      sim riscv-elf -w spec    // sweep bimodal or gshare sizes in one run, may be\n");
+  printf("                               // repeated. spec is bimodal or gshare followed by\n");
+  printf("                               // [:entries=MIN-MAX,history=MIN-MAX,bits=N]\n");
   printf("    prog-args: arguments to the simulated program\n");
   printf("               these arguments are provided through argv. Puts '--' in argv[0]\n");
   printf("      sim riscv-elf -- gylletank   // run riscv-elf with 'gylletank' in argv[1]\n");
@@ -43,15 +64,15 @@ int pass_args_to_program(struct memory *mem, int argc, char *argv[]) {
     unsigned argv_addr = 0x1000004;
     unsigned str_addr = argv_addr + 4 * num_args;
     memory_wr_w(mem, count_addr, num_args);
+    unsigned *arg_ptrs = malloc(4 * num_args);
     for (int index = 0; index < num_args; ++index) {
-      memory_wr_w(mem, argv_addr + 4 * index, str_addr);
-      char *cp = argv[first_arg + index];
-      int c;
-      do {
-        c = *cp++;
-        memory_wr_b(mem, str_addr++, c);
-      } while (c);
+      arg_ptrs[index] = str_addr;
+      size_t len = strlen(argv[first_arg + index]) + 1;
+      memory_write_block(mem, str_addr, argv[first_arg + index], len);
+      str_addr += len;
     }
+    memory_write_block(mem, argv_addr, arg_ptrs, 4 * num_args);
+    free(arg_ptrs);
   }
   // leave it to main to handle args before the seperator
   return seperator_position;
@@ -60,81 +81,234 @@ int pass_args_to_program(struct memory *mem, int argc, char *argv[]) {
 // Helper function, prints disassembly
 void disassemble_to_stdout(struct memory *mem, struct program_info *prog_info) {
   char disassembly[BUFFSIZE];
+  struct disasm_cache *cache = disasm_cache_create();
   for (unsigned int addr = prog_info->text_start; addr < prog_info->text_end; addr += 4) {
     unsigned int instruction = memory_rd_w(mem, addr);
-    disassemble(addr, instruction, disassembly, BUFFSIZE);
+    // Unknown words leave the buffer as it was, like disassemble() does
+    size_t length;
+    const char *text = disasm_cache_lookup(cache, addr, instruction, &length);
+    if (text) {
+      length = length < BUFFSIZE ? length : BUFFSIZE - 1;
+      memcpy(disassembly, text, length);
+      disassembly[length] = '\0';
+    }
     printf("%8x : %08X       %s\n", addr, instruction, disassembly);
   }
+  disasm_cache_delete(cache);
 }
 
 int main(int argc, char *argv[]) {
-  struct memory *mem = memory_create();
-  argc = pass_args_to_program(mem, argc, argv);
-  if (argc == 2 || argc == 3 || argc == 4) {
-    FILE *log_file = NULL;
-    FILE *prof_file = NULL;
-    if (argc == 4 && !strcmp(argv[2], "-l")) {
-      log_file = fopen(argv[3], "w");
+  int num_args = argc;
+  argc = 1;
+  while (argc < num_args && strcmp(argv[argc], "--"))
+    argc++;
+  if (argc < 2) {
+    terminate("Missing operands");
+  }
+  FILE *log_file = NULL;
+  FILE *prof_file = NULL;
+  FILE *prof_folded = NULL;
+  const char *summary_name = NULL;
+  int disassemble_only = 0;
+  struct sim_options options = {.engine = ENGINE_SWITCH, .predictors = predictor_set_create()};
+  const char *engine_name = NULL; // as given with -e
+  enum memory_backend backend = MEMORY_PAGED;
+  long int hot_branches = 0;
+  for (int arg = 2; arg < argc; ++arg) {
+    const char *opt = argv[arg];
+    if (!strcmp(opt, "-d")) {
+      disassemble_only = 1;
+      continue;
+    }
+    if (arg + 1 >= argc) {
+      terminate("Missing operands");
+    }
+    const char *value = argv[++arg];
+    if (!strcmp(opt, "-l")) {
+      log_file = fopen(value, "w");
       if (log_file == NULL) {
         terminate("Could not open logfile, terminating.");
       }
-    }
-    if (argc == 4 && !strcmp(argv[2], "-p")) {
-      prof_file = fopen(argv[3], "w");
+    } else if (!strcmp(opt, "-p")) {
+      prof_file = fopen(value, "w");
       if (prof_file == NULL) {
         terminate("Could not open file for exec profile, terminating.");
       }
+      char folded_name[strlen(value) + sizeof(".folded")];
+      snprintf(folded_name, sizeof(folded_name), "%s.folded", value);
+      prof_folded = fopen(folded_name, "w");
+      if (prof_folded == NULL) {
+        terminate("Could not open file for exec profile, terminating.");
+      }
+    } else if (!strcmp(opt, "-s")) {
+      summary_name = value;
+    } else if (!strcmp(opt, "-L")) {
+      options.binlog = binlog_create(value);
+      if (options.binlog == NULL) {
+        terminate("Could not open binary log, terminating.");
+      }
+    } else if (!strcmp(opt, "-t")) {
+      options.trace = btrace_create(value);
+      if (options.trace == NULL) {
+        terminate("Could not open branch trace file, terminating.");
+      }
+    } else if (!strcmp(opt, "-o")) {
+      options.outcomes = outcome_create(value);
+      if (options.outcomes == NULL) {
+        terminate("Could not open branch outcome file, terminating.");
+      }
+    } else if (!strcmp(opt, "-e")) {
+      engine_name = value;
+      if (!strcmp(value, "switch"))
+        options.engine = ENGINE_SWITCH;
+      else if (!strcmp(value, "threaded"))
+        options.engine = ENGINE_THREADED;
+      else if (!strcmp(value, "block"))
+        options.engine = ENGINE_BLOCK;
+      else if (!strcmp(value, "jit"))
+        options.engine = ENGINE_JIT;
+      else
+        terminate("Unknown engine");
+    } else if (!strcmp(opt, "-b")) {
+      if (!predictor_set_add(options.predictors, value))
+        terminate("Bad predictor specification");
+    } else if (!strcmp(opt, "-B")) {
+      if (options.btb)
+        btb_delete(options.btb);
+      options.btb = btb_create(value);
+      if (options.btb == NULL)
+        terminate("Bad BTB specification");
+    } else if (!strcmp(opt, "-H")) {
+      char *end;
+      hot_branches = strtol(value, &end, 0);
+      if (*end || hot_branches < 1)
+        terminate("Bad number of hot branches");
+    } else if (!strcmp(opt, "-w")) {
+      if (options.sweep == NULL)
+        options.sweep = predictor_sweep_create();
+      if (!predictor_sweep_add(options.sweep, value))
+        terminate("Bad sweep specification");
+    } else if (!strcmp(opt, "-m")) {
+      if (!strcmp(value, "paged"))
+        backend = MEMORY_PAGED;
+      else if (!strcmp(value, "flat"))
+        backend = MEMORY_FLAT;
+      else
+        terminate("Unknown memory model");
+    } else {
+      terminate("Unknown option");
     }
-    struct program_info prog_info;
-    int status = read_elf(mem, &prog_info, argv[1], log_file);
-    if (status)
-      exit(status);
-    // The use of symbols provide for a nicer disassembly, but their us in A4 is optional,
-    // so feel free to remove/ignore setup and use of symbols.
-    struct symbols *symbols = symbols_read_from_elf(argv[1]);
-    if (symbols == NULL) {
-      exit(-1);
-    }
-    if (argc == 3 && !strcmp(argv[2], "-d")) {
-      // disassemble text segment to stdout
-      disassemble_to_stdout(mem, &prog_info);
-      exit(0);
-    }
-    fflush(stdout);
-    int start_addr = prog_info.start;
-    clock_t before = clock();
-    struct Stat stats = simulate(mem, start_addr, log_file, NULL);
+  }
+  // Only the switch engine writes the logs, so -l and -L override the engine asked for
+  if ((log_file || options.binlog) && engine_name && options.engine != ENGINE_SWITCH) {
+    if (log_file && options.binlog)
+      fprintf(stderr, "Warning: -l and -L run the switch engine, not %s\n", engine_name);
+    else
+      fprintf(stderr, "Warning: %s runs the switch engine, not %s\n", log_file ? "-l" : "-L",
+              engine_name);
+  } else if (prof_file && engine_name && options.engine == ENGINE_THREADED) {
+    // The threaded engine cannot count per instruction, so -p runs the block engine instead
+    fprintf(stderr, "Warning: -p runs the block engine, not %s\n", engine_name);
+  }
+  if (options.predictors->count == 0)
+    predictor_set_add_defaults(options.predictors);
+  if (hot_branches)
+    options.profile = bprofile_create(options.predictors->count);
+  struct memory *mem = memory_create(backend);
+  if (mem == NULL) {
+    terminate("Could not reserve simulated memory, terminating.");
+  }
+  pass_args_to_program(mem, num_args, argv);
+  struct program_info prog_info;
+  struct elf_file *elf = elf_open(argv[1]);
+  if (elf == NULL)
+    exit(-1);
+  int status = read_elf(mem, &prog_info, elf);
+  if (status)
+    exit(status);
+  // The use of symbols provide for a nicer disassembly, but their us in A4 is optional,
+  // so feel free to remove/ignore setup and use of symbols.
+  struct symbols *symbols = symbols_read_from_elf(elf);
+  if (symbols == NULL) {
+    exit(-1);
+  }
+  if (prof_file)
+    options.exec_profile = eprofile_create(prog_info.text_start, prog_info.text_end);
+  if (disassemble_only) {
+    // disassemble text segment to stdout
+    disassemble_to_stdout(mem, &prog_info);
+    exit(0);
+  }
+  fflush(stdout);
+  clock_t before = clock();
+  struct Stat stats = simulate(mem, &prog_info, log_file, NULL, &options);
+  if (options.trace && btrace_close(options.trace) < 0)
+    fprintf(stderr, "Error writing branch trace\n");
+  if (options.outcomes && outcome_close(options.outcomes) < 0)
+    fprintf(stderr, "Error writing branch outcomes\n");
+  if (options.binlog && binlog_close(options.binlog) < 0)
+    fprintf(stderr, "Error writing binary log\n");
 
-    // Status report.
+  // Status report.
 
-    long int num_insns = stats.insns;
-    clock_t after = clock();
-    int ticks = after - before;
-    double mips = (1.0 * num_insns * CLOCKS_PER_SEC) / ticks / 1000000;
+  long int num_insns = stats.insns;
+  clock_t after = clock();
+  int ticks = after - before;
+  double mips = (1.0 * num_insns * CLOCKS_PER_SEC) / ticks / 1000000;
+  fflush(stdout);
+  if (summary_name) {
     fflush(stdout);
-    if (argc == 4 && !strcmp(argv[2], "-s")) {
-      fflush(stdout);
-      log_file = fopen(argv[3], "w");
-      if (log_file == NULL) {
-        terminate("Could not open logfile, terminating.");
-      }
-    }
-    if (log_file) {
-      fprintf(log_file, "Total executed instructions  : %ld\n", stats.insns);
-      fprintf(log_file, "Total branches executed      : %ld\n", stats.branches);
-      fprintf(log_file, "Wrong predictions NT         : %ld\n", stats.wrong_nt);
-      fprintf(log_file, "Wrong predictions BTFNT      : %ld\n", stats.wrong_btfnt);
-      fprintf(log_file, "Wrong predictions BIMODAL    : %ld\n", stats.wrong_bimodal);
-      fprintf(log_file, "Wrong predictions GSHARE     : %ld\n", stats.wrong_gshare);
-      fprintf(log_file, "\nSimulated %ld instructions in %d host ticks (%f MIPS)\n", num_insns,
-              ticks, mips);
+    if (log_file)
       fclose(log_file);
-    } else {
-      printf("\nSimulated %ld instructions in %d host ticks (%f MIPS)\n", num_insns, ticks, mips);
+    log_file = fopen(summary_name, "w");
+    if (log_file == NULL) {
+      terminate("Could not open logfile, terminating.");
+    }
+  }
+  if (log_file) {
+    fprintf(log_file, "Total executed instructions  : %ld\n", stats.insns);
+    fprintf(log_file, "Total branches executed      : %ld\n", stats.branches);
+    predictor_set_print(options.predictors, log_file);
+    if (options.btb) {
+      fprintf(log_file, "Target predictor             : ");
+      btb_describe(options.btb, log_file);
+      fprintf(log_file, "Total jumps executed         : %ld\n", stats.jumps);
+      fprintf(log_file, "Wrong targets BTB            : %ld\n", stats.btb_wrong);
+      fprintf(log_file, "Total returns executed       : %ld\n", stats.returns);
+      fprintf(log_file, "Wrong targets RAS            : %ld\n", stats.ras_wrong);
     }
-    memory_delete(mem);
+    struct memory_stats mem_stats;
+    if (memory_get_stats(mem, &mem_stats)) {
+      fprintf(log_file, "Pages allocated              : %ld\n", mem_stats.pages_allocated);
+      fprintf(log_file, "Pages read from zero page    : %ld\n", mem_stats.zero_page_served);
+    }
+    fprintf(log_file, "\nSimulated %ld instructions in %d host ticks (%f MIPS)\n", num_insns,
+            ticks, mips);
+    if (options.sweep)
+      predictor_sweep_print(options.sweep, stats.branches, log_file);
+    if (options.profile)
+      bprofile_print(options.profile, options.predictors, symbols, hot_branches, log_file);
+    fclose(log_file);
   } else {
-    terminate("Missing operands");
-    memory_delete(mem);
+    printf("\nSimulated %ld instructions in %d host ticks (%f MIPS)\n", num_insns, ticks, mips);
+    if (options.sweep)
+      predictor_sweep_print(options.sweep, stats.branches, stdout);
+    if (options.profile)
+      bprofile_print(options.profile, options.predictors, symbols, hot_branches, stdout);
+  }
+  if (options.exec_profile) {
+    eprofile_print(options.exec_profile, symbols, mem, prof_file);
+    eprofile_print_collapsed(options.exec_profile, symbols, prof_folded);
+    fclose(prof_file);
+    fclose(prof_folded);
+    eprofile_delete(options.exec_profile);
   }
+  if (options.profile)
+    bprofile_delete(options.profile);
+  if (options.sweep)
+    predictor_sweep_delete(options.sweep);
+  if (options.btb)
+    btb_delete(options.btb);
+  predictor_set_delete(options.predictors);
+  memory_delete(mem);
 }
@@ -1,19 +1,39 @@
 #include "memory.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <sys/mman.h>
 
-struct memory
-{
-  int *pages[0x10000];
-};
+#define FLAT_SIZE (1ull << 32)
+#define PAGE_SIZE 65536
+
+static const unsigned char zero_page[PAGE_SIZE];
+static void (*fault_hook)(void) = NULL;
 
-struct memory *memory_create(void)
+struct memory *memory_create(enum memory_backend backend)
 {
-  return calloc(sizeof(struct memory), 1);
+  struct memory *mem = calloc(sizeof(struct memory), 1);
+  for (int j = 0; j < MEMORY_TLB_ENTRIES; ++j)
+    mem->tlb[j].page = MEMORY_TLB_INVALID;
+  if (backend == MEMORY_FLAT)
+  {
+    // Reserver hele gæstens adresserum uden at binde lager; kernen udleverer
+    // nulstillede sider, efterhånden som de bliver rørt.
+    void *base = mmap(NULL, FLAT_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+    {
+      free(mem);
+      return NULL;
+    }
+    mem->flat = base;
+  }
+  return mem;
 }
 
 void memory_delete(struct memory *mem)
 {
+  if (mem->flat)
+    munmap(mem->flat, FLAT_SIZE);
   for (int j = 0; j < 0x10000; ++j)
   {
     if (mem->pages[j])
@@ -22,107 +42,105 @@ void memory_delete(struct memory *mem)
   free(mem);
 }
 
-int *get_page(struct memory *mem, int addr)
+unsigned char *memory_page_miss(struct memory *mem, int addr)
 {
   int page_number = (addr >> 16) & 0x0ffff;
   if (mem->pages[page_number] == NULL)
   {
-    mem->pages[page_number] = calloc(65536, 1);
+    mem->pages[page_number] = calloc(PAGE_SIZE, 1);
+    mem->stats.pages_allocated++;
   }
-  return mem->pages[page_number];
+  struct memory_tlb_entry *entry = &mem->tlb[page_number & (MEMORY_TLB_ENTRIES - 1)];
+  entry->page = page_number;
+  entry->data = mem->pages[page_number];
+  return entry->data;
 }
 
-void memory_wr_w(struct memory *mem, int addr, int data)
+const unsigned char *memory_page_miss_rd(struct memory *mem, int addr)
 {
-  if (addr & 0x3)
+  int page_number = (addr >> 16) & 0x0ffff;
+  if (mem->pages[page_number])
+    return memory_page_miss(mem, addr);
+  unsigned char bit = 1 << (page_number & 7);
+  if ((mem->zero_served[page_number >> 3] & bit) == 0)
   {
-    printf("Unaligned word write to %x\n", addr);
-    exit(-1);
+    mem->zero_served[page_number >> 3] |= bit;
+    mem->stats.zero_page_served++;
   }
-  int *page = get_page(mem, addr);
-  page[(addr >> 2) & 0x3fff] = data;
+  return zero_page;
 }
 
-void memory_wr_h(struct memory *mem, int addr, int data)
+// Bytes fra addr til slutningen af dens side, højst len
+static size_t page_run(int addr, size_t len)
 {
-  if (addr & 0x1)
-  {
-    printf("Unaligned halfword write to %x\n", addr);
-    exit(-1);
-  }
-  int *page = get_page(mem, addr);
-  int index = (addr >> 2) & 0x3fff;
-  if ((addr & 2) == 0)
-    page[index] = (page[index] & 0xffff0000) | (data & 0x0000ffff);
-  else
-    page[index] = (page[index] & 0x0000ffff) | ((unsigned)data << 16);
+  size_t run = PAGE_SIZE - (addr & 0xffff);
+  return run < len ? run : len;
 }
 
-void memory_wr_b(struct memory *mem, int addr, int data)
+void memory_write_block(struct memory *mem, int addr, const void *src, size_t len)
 {
-  int *page = get_page(mem, addr);
-  int index = (addr >> 2) & 0x3fff;
-  switch (addr & 0x3)
+  const unsigned char *from = src;
+  while (len)
   {
-  case 0:
-    page[index] = (page[index] & 0xffffff00) | (data & 0xff);
-    break;
-  case 1:
-    page[index] = (page[index] & 0xffff00ff) | ((data & 0xff) << 8);
-    break;
-  case 2:
-    page[index] = (page[index] & 0xff00ffff) | ((data & 0xff) << 16);
-    break;
-  case 3:
-    page[index] = (page[index] & 0x00ffffff) | (((unsigned)(data & 0xff)) << 24);
-    break;
+    size_t run = page_run(addr, len);
+    memcpy(memory_host(mem, addr), from, run);
+    from += run;
+    addr += run;
+    len -= run;
   }
 }
 
-int memory_rd_w(struct memory *mem, int addr)
+void memory_read_block(struct memory *mem, int addr, void *dst, size_t len)
 {
-  int *page = get_page(mem, addr);
-  if (addr & 0x3)
+  unsigned char *to = dst;
+  while (len)
   {
-    printf("Unaligned word read from %x\n", addr);
-    exit(-1);
+    size_t run = page_run(addr, len);
+    memcpy(to, memory_host_rd(mem, addr), run);
+    to += run;
+    addr += run;
+    len -= run;
   }
-  return page[(addr >> 2) & 0x3fff];
 }
 
-int memory_rd_h(struct memory *mem, int addr)
+void memory_zero_block(struct memory *mem, int addr, size_t len)
 {
-  int *page = get_page(mem, addr);
-  int index = (addr >> 2) & 0x3fff;
-  if (addr & 0x1)
+  while (len)
   {
-    printf("Unaligned halfword read from %x\n", addr);
-    exit(-1);
+    size_t run = page_run(addr, len);
+    if (mem->flat || mem->pages[(addr >> 16) & 0x0ffff])
+      memset(memory_host(mem, addr), 0, run);
+    addr += run;
+    len -= run;
   }
-  if ((addr & 2) == 0)
-    return page[index] & 0xffff;
-  else
-    return (page[index] >> 16) & 0xffff;
 }
 
-int memory_rd_b(struct memory *mem, int addr)
+int memory_map_file(struct memory *mem, int addr, int fd, long int offset, size_t len)
 {
-  int *page = get_page(mem, addr);
-  int index = (addr >> 2) & 0x3fff;
-  switch (addr & 0x3)
-  {
-  case 0:
-    return page[index] & 0xff;
-    break;
-  case 1:
-    return (page[index] >> 8) & 0xff;
-    break;
-  case 2:
-    return (page[index] >> 16) & 0xff;
-    break;
-  case 3:
-    return (page[index] >> 24) & 0xff;
-    break;
-  }
-  return 0; // silence a warning
+  if (mem->flat == NULL)
+    return 0;
+  void *at = mem->flat + (unsigned int)addr;
+  void *p = mmap(at, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset);
+  return p == at;
+}
+
+int memory_get_stats(struct memory *mem, struct memory_stats *stats)
+{
+  if (mem->flat)
+    return 0;
+  *stats = mem->stats;
+  return 1;
+}
+
+void memory_set_fault_hook(void (*hook)(void))
+{
+  fault_hook = hook;
+}
+
+void memory_unaligned(const char *access, int addr)
+{
+  if (fault_hook)
+    fault_hook();
+  printf("Unaligned %s %x\n", access, addr);
+  exit(-1);
 }
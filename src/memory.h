@@ -1,19 +1,146 @@
 #ifndef __MEMORY_H__
 #define __MEMORY_H__
 
-struct memory;
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
-// opret/nedlæg lager
-struct memory *memory_create(void);
+// Gæstens ord kopieres med memcpy i værtens byte-rækkefølge, hvilket kun er rigtigt på en
+// little-endian vært
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "The simulator needs a little-endian host"
+#endif
+
+// Lageret er delt i 0x10000 sider på 64 KiB, som allokeres ved første brug. En lille
+// direkte-afbildet TLB husker de senest brugte sider, så gentagne tilgange til samme side
+// kun koster en sammenligning og et opslag. Læsning fra en side der aldrig er skrevet
+// allokerer ikke, men besvares fra en fælles nul-side.
+//
+// Alternativt kan hele det 4 GiB store adresserum reserveres med én mmap (MEMORY_FLAT). Så
+// allokerer værtens kerne siderne ved behov, og en adresse oversættes blot til base + addr.
+enum memory_backend
+{
+  MEMORY_PAGED,
+  MEMORY_FLAT
+};
+#define MEMORY_TLB_ENTRIES 16
+
+struct memory_tlb_entry
+{
+  unsigned int page; // sidenummer, eller MEMORY_TLB_INVALID
+  unsigned char *data;
+};
+
+#define MEMORY_TLB_INVALID 0xffffffffu
+
+// sidetællere for MEMORY_PAGED
+struct memory_stats
+{
+  long int pages_allocated;   // sider allokeret ved skrivning
+  long int zero_page_served;  // forskellige sider hvor læsning blev besvaret af nul-siden
+};
+
+struct memory
+{
+  unsigned char *flat; // basen for MEMORY_FLAT, ellers NULL
+  struct memory_tlb_entry tlb[MEMORY_TLB_ENTRIES];
+  unsigned char *pages[0x10000];
+  struct memory_stats stats;
+  unsigned char zero_served[0x10000 / 8]; // bitmap over sider læst fra nul-siden
+};
+
+// opret/nedlæg lager. Returnerer NULL hvis det flade adresserum ikke kan reserveres
+struct memory *memory_create(enum memory_backend backend);
 void memory_delete(struct memory *);
 
+// hent sidetællerne. Returnerer 0 for MEMORY_FLAT, hvor værtens kerne styrer siderne
+int memory_get_stats(struct memory *mem, struct memory_stats *stats);
+
+// kopier hele blokke til/fra lager, en side ad gangen med memcpy
+void memory_write_block(struct memory *mem, int addr, const void *src, size_t len);
+void memory_read_block(struct memory *mem, int addr, void *dst, size_t len);
+// nulstil en blok (f.eks. .bss); sider der aldrig er skrevet er allerede nul og røres ikke
+void memory_zero_block(struct memory *mem, int addr, size_t len);
+
+// afbild len bytes af filen fd fra offset copy-on-write på addr. Kun MEMORY_FLAT kan det;
+// returnerer 0 hvis det ikke lader sig gøre, så kalderen må kopiere i stedet
+int memory_map_file(struct memory *mem, int addr, int fd, long int offset, size_t len);
+
+// langsom vej: slå siden op (og alloker den) og læg den i TLB'en
+unsigned char *memory_page_miss(struct memory *mem, int addr);
+// langsom vej for læsning: en ikke-allokeret side giver nul-siden, som ikke kommer i TLB'en
+const unsigned char *memory_page_miss_rd(struct memory *mem, int addr);
+// rapporter en ikke-justeret tilgang og stop simulationen
+void memory_unaligned(const char *access, int addr) __attribute__((noreturn));
+// kaldes lige før en lagerfejl stopper processen, så simulatoren kan tømme sine buffere
+void memory_set_fault_hook(void (*hook)(void));
+
+// Værtsadressen for en gæsteadresse. Siderne gemmes byte for byte i gæstens little-endian
+// rækkefølge, så hver tilgang er en enkelt load eller store.
+static inline unsigned char *memory_host(struct memory *mem, int addr)
+{
+  if (mem->flat)
+    return mem->flat + (unsigned int)addr;
+  unsigned int page = (unsigned int)addr >> 16;
+  struct memory_tlb_entry *entry = &mem->tlb[page & (MEMORY_TLB_ENTRIES - 1)];
+  if (entry->page == page)
+    return entry->data + (addr & 0xffff);
+  return memory_page_miss(mem, addr) + (addr & 0xffff);
+}
+
+static inline const unsigned char *memory_host_rd(struct memory *mem, int addr)
+{
+  if (mem->flat)
+    return mem->flat + (unsigned int)addr;
+  unsigned int page = (unsigned int)addr >> 16;
+  struct memory_tlb_entry *entry = &mem->tlb[page & (MEMORY_TLB_ENTRIES - 1)];
+  if (entry->page == page)
+    return entry->data + (addr & 0xffff);
+  return memory_page_miss_rd(mem, addr) + (addr & 0xffff);
+}
+
 // skriv word/halfword/byte til lager
-void memory_wr_w(struct memory *mem, int addr, int data);
-void memory_wr_h(struct memory *mem, int addr, int data);
-void memory_wr_b(struct memory *mem, int addr, int data);
+static inline void memory_wr_w(struct memory *mem, int addr, int data)
+{
+  if (addr & 0x3)
+    memory_unaligned("word write to", addr);
+  memcpy(memory_host(mem, addr), &data, 4);
+}
+
+static inline void memory_wr_h(struct memory *mem, int addr, int data)
+{
+  if (addr & 0x1)
+    memory_unaligned("halfword write to", addr);
+  uint16_t half = data;
+  memcpy(memory_host(mem, addr), &half, 2);
+}
+
+static inline void memory_wr_b(struct memory *mem, int addr, int data)
+{
+  *memory_host(mem, addr) = data;
+}
 
 // læs word/halfword/byte fra lager - data er nul-forlænget
-int memory_rd_w(struct memory *mem, int addr);
-int memory_rd_h(struct memory *mem, int addr);
-int memory_rd_b(struct memory *mem, int addr);
+static inline int memory_rd_w(struct memory *mem, int addr)
+{
+  if (addr & 0x3)
+    memory_unaligned("word read from", addr);
+  int data;
+  memcpy(&data, memory_host_rd(mem, addr), 4);
+  return data;
+}
+
+static inline int memory_rd_h(struct memory *mem, int addr)
+{
+  if (addr & 0x1)
+    memory_unaligned("halfword read from", addr);
+  uint16_t half;
+  memcpy(&half, memory_host_rd(mem, addr), 2);
+  return half;
+}
+
+static inline int memory_rd_b(struct memory *mem, int addr)
+{
+  return *memory_host_rd(mem, addr);
+}
 #endif
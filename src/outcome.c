@@ -0,0 +1,26 @@
+#include "outcome.h"
+#include <stdlib.h>
+
+struct outcome_writer *outcome_create(const char *name) {
+  FILE *file = fopen(name, "wb");
+  if (file == NULL)
+    return NULL;
+  return outcome_create_file(file);
+}
+
+struct outcome_writer *outcome_create_file(FILE *file) {
+  const unsigned char header[OUTCOME_HEADER_SIZE] = {'R', 'V', 'B', 'O', OUTCOME_VERSION, 0, 0, 0};
+  fwrite(header, 1, sizeof(header), file);
+  struct outcome_writer *w = malloc(sizeof(struct outcome_writer));
+  w->file = file;
+  w->fill = 0;
+  return w;
+}
+
+int outcome_close(struct outcome_writer *w) {
+  outcome_flush(w);
+  int error = ferror(w->file);
+  error |= fclose(w->file);
+  free(w);
+  return error ? -1 : 0;
+}
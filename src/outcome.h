@@ -0,0 +1,59 @@
+#ifndef __OUTCOME_H__
+#define __OUTCOME_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+// The records are written and mapped in host byte order
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "Branch outcome dumps need a little-endian host"
+#endif
+
+// Branch outcome dump, written by sim -o and replayed by predsim. It holds exactly what the
+// predictors are fed: an 8 byte header ("RVBO" and a little-endian version) followed by one
+// little-endian uint32 per conditional branch,
+//   pc & ~3 | backward << 1 | taken
+// where pc is the pc after the branch, as the predictors see it, and backward tells whether the
+// branch offset was negative. The offset itself is not kept, so replay hands the predictors -4
+// or 4 in its place.
+
+#define OUTCOME_VERSION 1
+#define OUTCOME_HEADER_SIZE 8
+#define OUTCOME_TAKEN 1u
+#define OUTCOME_BACKWARD 2u
+
+static inline uint32_t outcome_encode(uint32_t pc, int32_t imm, int taken) {
+  return (pc & ~3u) | (imm < 0 ? OUTCOME_BACKWARD : 0) | (taken ? OUTCOME_TAKEN : 0);
+}
+
+static inline uint32_t outcome_pc(uint32_t record) { return record & ~3u; }
+static inline int32_t outcome_imm(uint32_t record) {
+  return record & OUTCOME_BACKWARD ? -4 : 4;
+}
+static inline int outcome_taken(uint32_t record) { return record & OUTCOME_TAKEN; }
+
+struct outcome_writer {
+  FILE *file;
+  size_t fill;
+  uint32_t buffer[1 << 14];
+};
+
+// Returns NULL if the file cannot be created
+struct outcome_writer *outcome_create(const char *name);
+// Write the dump to a file that is already open, such as a temporary one
+struct outcome_writer *outcome_create_file(FILE *file);
+// Flush, close and free. Returns 0 on success, -1 on a write error.
+int outcome_close(struct outcome_writer *w);
+
+static inline void outcome_flush(struct outcome_writer *w) {
+  fwrite(w->buffer, sizeof(uint32_t), w->fill, w->file);
+  w->fill = 0;
+}
+
+static inline void outcome_write(struct outcome_writer *w, uint32_t pc, int32_t imm, int taken) {
+  if (w->fill == sizeof(w->buffer) / sizeof(w->buffer[0]))
+    outcome_flush(w);
+  w->buffer[w->fill++] = outcome_encode(pc, imm, taken);
+}
+
+#endif
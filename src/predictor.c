@@ -0,0 +1,744 @@
+#include "predictor.h"
+#include <math.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+
+// Static predictors
+
+static struct predictor *static_create(const struct predictor_params *params) {
+  (void)params;
+  return calloc(1, sizeof(struct predictor));
+}
+
+static void static_update(struct predictor *p, uint32_t pc, int32_t imm, int taken) {
+  (void)p;
+  (void)pc;
+  (void)imm;
+  (void)taken;
+}
+
+static void static_reset(struct predictor *p) { (void)p; }
+
+static void static_destroy(struct predictor *p) { free(p); }
+
+static int nt_predict(struct predictor *p, uint32_t pc, int32_t imm) {
+  (void)p;
+  (void)pc;
+  (void)imm;
+  return 0;
+}
+
+// Backwards taken, forwards not taken
+static int btfnt_predict(struct predictor *p, uint32_t pc, int32_t imm) {
+  (void)p;
+  (void)pc;
+  return imm < 0;
+}
+
+// Table of saturating counters, indexed by pc alone (bimodal) or by pc xor global history
+// (gshare)
+
+struct counter_predictor {
+  struct predictor base;
+  unsigned int mask;
+  unsigned int history_mask;
+  unsigned int ghr;
+  unsigned char max;
+  unsigned char threshold;
+  unsigned char *table;
+};
+
+static struct predictor *counter_create(const struct predictor_params *params) {
+  if (params->entries == 0 || (params->entries & (params->entries - 1))) {
+    fprintf(stderr, "Predictor table size must be a power of two\n");
+    return NULL;
+  }
+  if (params->max < 1 || params->max > 255 || params->history > 31) {
+    fprintf(stderr, "Predictor counter maximum must be 1-255 and history at most 31 bits\n");
+    return NULL;
+  }
+  struct counter_predictor *c = calloc(1, sizeof(struct counter_predictor));
+  c->mask = params->entries - 1;
+  c->history_mask = (1u << params->history) - 1;
+  c->max = params->max;
+  c->threshold = (params->max + 1) / 2;
+  c->table = malloc(params->entries);
+  return &c->base;
+}
+
+static void counter_reset(struct predictor *p) {
+  struct counter_predictor *c = (struct counter_predictor *)p;
+  memset(c->table, c->max / 2, c->mask + 1);
+  c->ghr = 0;
+}
+
+static void counter_destroy(struct predictor *p) {
+  struct counter_predictor *c = (struct counter_predictor *)p;
+  free(c->table);
+  free(c);
+}
+
+static inline void counter_train(struct counter_predictor *c, unsigned int index, int taken) {
+  if (taken) {
+    if (c->table[index] < c->max)
+      c->table[index]++;
+  } else {
+    if (c->table[index] > 0)
+      c->table[index]--;
+  }
+}
+
+static int bimodal_predict(struct predictor *p, uint32_t pc, int32_t imm) {
+  (void)imm;
+  struct counter_predictor *c = (struct counter_predictor *)p;
+  return c->table[(pc >> 2) & c->mask] >= c->threshold;
+}
+
+static void bimodal_update(struct predictor *p, uint32_t pc, int32_t imm, int taken) {
+  (void)imm;
+  struct counter_predictor *c = (struct counter_predictor *)p;
+  counter_train(c, (pc >> 2) & c->mask, taken);
+}
+
+static int gshare_predict(struct predictor *p, uint32_t pc, int32_t imm) {
+  (void)imm;
+  struct counter_predictor *c = (struct counter_predictor *)p;
+  return c->table[((pc >> 2) ^ c->ghr) & c->mask] >= c->threshold;
+}
+
+static void gshare_update(struct predictor *p, uint32_t pc, int32_t imm, int taken) {
+  (void)imm;
+  struct counter_predictor *c = (struct counter_predictor *)p;
+  counter_train(c, ((pc >> 2) ^ c->ghr) & c->mask, taken);
+  c->ghr = ((c->ghr << 1) | taken) & c->history_mask;
+}
+
+// TAGE: a bimodal base table backed by tagged tables indexed with geometrically growing
+// global history lengths. The longest matching table provides the prediction. Histories are
+// kept folded down to index and tag width and updated incrementally, so the work per branch
+// grows with the number of tables, not with history length.
+
+#define TAGE_MAX_TABLES 15
+#define TAGE_MAX_HISTORY 1023
+#define TAGE_HISTORY_BUFFER 1024 // power of two above TAGE_MAX_HISTORY
+#define TAGE_CTR_MAX 3           // signed 3-bit prediction counters, taken when >= 0
+#define TAGE_CTR_MIN -4
+#define TAGE_U_MAX 3             // 2-bit useful counters
+#define TAGE_U_PERIOD (1u << 18) // branches between halvings of every useful counter
+
+struct tage_entry {
+  int8_t ctr;
+  uint8_t u;
+  uint16_t tag;
+};
+
+// A history of length bits folded to width bits by xor
+struct tage_fold {
+  uint32_t comp;
+  uint32_t mask;         // width bits
+  unsigned int width;
+  unsigned int outpoint; // where the bit leaving the history lands, length % width
+};
+
+struct tage_predictor {
+  struct predictor base;
+  unsigned int num_tables;
+  unsigned int index_mask;
+  unsigned int tag_mask;
+  unsigned int base_mask;
+  struct tage_entry *tables[TAGE_MAX_TABLES];
+  unsigned int history_length[TAGE_MAX_TABLES];
+  struct tage_fold fold_index[TAGE_MAX_TABLES];
+  struct tage_fold fold_tag[2][TAGE_MAX_TABLES];
+  uint8_t *base_table; // 2-bit counters
+  uint8_t history[TAGE_HISTORY_BUFFER]; // one outcome per byte, newest at history_pos
+  unsigned int history_pos;
+  int use_alt_on_na; // when >= 0, newly allocated weak entries defer to the alternate prediction
+  uint32_t lfsr;
+  unsigned int branches;
+  // Lookup made by predict() and reused by update()
+  uint32_t pc;
+  unsigned int index[TAGE_MAX_TABLES];
+  uint16_t tag[TAGE_MAX_TABLES];
+  int provider; // longest matching table, -1 for none
+  int alt;      // next matching table below the provider, -1 for the base table
+  int provider_pred;
+  int alt_pred;
+  int pred;
+};
+
+static void tage_fold_init(struct tage_fold *f, unsigned int length, unsigned int width) {
+  f->comp = 0;
+  f->mask = (1u << width) - 1;
+  f->width = width;
+  f->outpoint = length % width;
+}
+
+// Shift in the newest outcome and cancel the one that just left the history
+static inline void tage_fold_update(struct tage_fold *f, uint32_t newest, uint32_t oldest) {
+  uint32_t comp = (f->comp << 1) | newest;
+  comp ^= oldest << f->outpoint;
+  comp ^= comp >> f->width;
+  f->comp = comp & f->mask;
+}
+
+static struct predictor *tage_create(const struct predictor_params *params) {
+  unsigned int n = params->tables;
+  if (params->entries < 16 || params->entries > (1u << 20) ||
+      (params->entries & (params->entries - 1))) {
+    fprintf(stderr, "TAGE table size must be a power of two from 16 to 1M entries\n");
+    return NULL;
+  }
+  if (n < 1 || n > TAGE_MAX_TABLES || params->tag_bits < 2 || params->tag_bits > 16) {
+    fprintf(stderr, "TAGE needs 1-%d tables and tags of 2-16 bits\n", TAGE_MAX_TABLES);
+    return NULL;
+  }
+  if (params->min_history < 1 || params->min_history > params->history ||
+      params->history > TAGE_MAX_HISTORY) {
+    fprintf(stderr, "TAGE histories must satisfy 1 <= minhist <= history <= %d\n",
+            TAGE_MAX_HISTORY);
+    return NULL;
+  }
+  struct tage_predictor *t = calloc(1, sizeof(struct tage_predictor));
+  unsigned int index_bits = 0;
+  while ((1u << index_bits) < params->entries)
+    index_bits++;
+  t->num_tables = n;
+  t->index_mask = params->entries - 1;
+  t->tag_mask = (1u << params->tag_bits) - 1;
+  t->base_mask = params->entries * 4 - 1;
+  t->base_table = malloc(params->entries * 4);
+  for (unsigned int i = 0; i < n; i++) {
+    // Geometric series from min_history to history
+    double ratio = n > 1 ? (double)params->history / params->min_history : 1.0;
+    double exponent = n > 1 ? (double)i / (n - 1) : 1.0;
+    unsigned int length = (unsigned int)(params->min_history * pow(ratio, exponent) + 0.5);
+    t->tables[i] = malloc(params->entries * sizeof(struct tage_entry));
+    t->history_length[i] = length;
+    tage_fold_init(&t->fold_index[i], length, index_bits);
+    tage_fold_init(&t->fold_tag[0][i], length, params->tag_bits);
+    tage_fold_init(&t->fold_tag[1][i], length, params->tag_bits - 1);
+  }
+  return &t->base;
+}
+
+static void tage_reset(struct predictor *p) {
+  struct tage_predictor *t = (struct tage_predictor *)p;
+  for (unsigned int i = 0; i < t->num_tables; i++) {
+    memset(t->tables[i], 0, (t->index_mask + 1) * sizeof(struct tage_entry));
+    t->fold_index[i].comp = 0;
+    t->fold_tag[0][i].comp = 0;
+    t->fold_tag[1][i].comp = 0;
+  }
+  memset(t->base_table, 2, t->base_mask + 1);
+  memset(t->history, 0, sizeof(t->history));
+  t->history_pos = 0;
+  t->use_alt_on_na = 0;
+  t->lfsr = 0xace1u;
+  t->branches = 0;
+  t->pc = 1; // no lookup cached; real pcs are word aligned
+}
+
+static void tage_destroy(struct predictor *p) {
+  struct tage_predictor *t = (struct tage_predictor *)p;
+  for (unsigned int i = 0; i < t->num_tables; i++)
+    free(t->tables[i]);
+  free(t->base_table);
+  free(t);
+}
+
+static void tage_lookup(struct tage_predictor *t, uint32_t pc) {
+  uint32_t a = pc >> 2;
+  // Kept in locals: the byte-sized table stores would otherwise force reloads through t
+  int provider = -1, alt = -1;
+  for (int i = t->num_tables - 1; i >= 0; i--) {
+    unsigned int index = (a ^ (a >> (i + 1)) ^ t->fold_index[i].comp) & t->index_mask;
+    uint16_t tag = (a ^ t->fold_tag[0][i].comp ^ (t->fold_tag[1][i].comp << 1)) & t->tag_mask;
+    t->index[i] = index;
+    t->tag[i] = tag;
+    if (t->tables[i][index].tag == tag) {
+      alt = provider < 0 ? alt : (alt < 0 ? i : alt);
+      provider = provider < 0 ? i : provider;
+    }
+  }
+  int alt_pred = alt >= 0 ? t->tables[alt][t->index[alt]].ctr >= 0
+                          : t->base_table[a & t->base_mask] >= 2;
+  int pred = alt_pred;
+  if (provider >= 0) {
+    const struct tage_entry *e = &t->tables[provider][t->index[provider]];
+    t->provider_pred = e->ctr >= 0;
+    int weak_new = e->u == 0 && (e->ctr == 0 || e->ctr == -1);
+    if (!weak_new || t->use_alt_on_na < 0)
+      pred = t->provider_pred;
+  }
+  t->pc = pc;
+  t->provider = provider;
+  t->alt = alt;
+  t->alt_pred = alt_pred;
+  t->pred = pred;
+}
+
+static inline void tage_ctr_train(int8_t *ctr, int taken) {
+  if (taken && *ctr < TAGE_CTR_MAX)
+    (*ctr)++;
+  else if (!taken && *ctr > TAGE_CTR_MIN)
+    (*ctr)--;
+}
+
+static inline void tage_base_train(struct tage_predictor *t, uint32_t pc, int taken) {
+  uint8_t *c = &t->base_table[(pc >> 2) & t->base_mask];
+  if (taken && *c < 3)
+    (*c)++;
+  else if (!taken && *c > 0)
+    (*c)--;
+}
+
+static int tage_predict(struct predictor *p, uint32_t pc, int32_t imm) {
+  (void)imm;
+  struct tage_predictor *t = (struct tage_predictor *)p;
+  tage_lookup(t, pc);
+  return t->pred;
+}
+
+static void tage_update(struct predictor *p, uint32_t pc, int32_t imm, int taken) {
+  (void)imm;
+  struct tage_predictor *t = (struct tage_predictor *)p;
+  if (t->pc != pc)
+    tage_lookup(t, pc);
+  struct tage_entry *provider =
+      t->provider >= 0 ? &t->tables[t->provider][t->index[t->provider]] : NULL;
+
+  // Learn whether fresh entries are worth trusting
+  if (provider && provider->u == 0 && (provider->ctr == 0 || provider->ctr == -1) &&
+      t->provider_pred != t->alt_pred) {
+    if (t->alt_pred == taken && t->use_alt_on_na < 7)
+      t->use_alt_on_na++;
+    else if (t->alt_pred != taken && t->use_alt_on_na > -8)
+      t->use_alt_on_na--;
+  }
+
+  // On a misprediction, take an entry in a longer table, skipping ahead at random one in two
+  // times so that allocations spread out
+  if (t->pred != taken && t->provider < (int)t->num_tables - 1) {
+    t->lfsr = (t->lfsr >> 1) ^ (-(t->lfsr & 1) & 0xb400u);
+    unsigned int start = t->provider + 1;
+    if (start + 1 < t->num_tables && (t->lfsr & 1))
+      start++;
+    int allocated = 0;
+    for (unsigned int i = start; i < t->num_tables && !allocated; i++) {
+      struct tage_entry *e = &t->tables[i][t->index[i]];
+      if (e->u == 0) {
+        e->tag = t->tag[i];
+        e->ctr = taken ? 0 : -1;
+        allocated = 1;
+      }
+    }
+    if (!allocated) {
+      for (unsigned int i = t->provider + 1; i < t->num_tables; i++) {
+        struct tage_entry *e = &t->tables[i][t->index[i]];
+        if (e->u > 0)
+          e->u--;
+      }
+    }
+  }
+
+  if (provider) {
+    // A provider that is not yet useful shares the training with the alternate prediction
+    if (provider->u == 0) {
+      if (t->alt >= 0)
+        tage_ctr_train(&t->tables[t->alt][t->index[t->alt]].ctr, taken);
+      else
+        tage_base_train(t, pc, taken);
+    }
+    tage_ctr_train(&provider->ctr, taken);
+    if (t->provider_pred != t->alt_pred) {
+      if (t->provider_pred == taken && provider->u < TAGE_U_MAX)
+        provider->u++;
+      else if (t->provider_pred != taken && provider->u > 0)
+        provider->u--;
+    }
+  } else {
+    tage_base_train(t, pc, taken);
+  }
+
+  // Age the useful counters so stale entries can be replaced
+  if (++t->branches == TAGE_U_PERIOD) {
+    t->branches = 0;
+    for (unsigned int i = 0; i < t->num_tables; i++) {
+      for (unsigned int j = 0; j <= t->index_mask; j++)
+        t->tables[i][j].u >>= 1;
+    }
+  }
+
+  uint32_t newest = taken != 0;
+  t->history_pos = (t->history_pos - 1) & (TAGE_HISTORY_BUFFER - 1);
+  t->history[t->history_pos] = newest;
+  for (unsigned int i = 0; i < t->num_tables; i++) {
+    uint32_t oldest =
+        t->history[(t->history_pos + t->history_length[i]) & (TAGE_HISTORY_BUFFER - 1)];
+    tage_fold_update(&t->fold_index[i], newest, oldest);
+    tage_fold_update(&t->fold_tag[0][i], newest, oldest);
+    tage_fold_update(&t->fold_tag[1][i], newest, oldest);
+  }
+  t->pc = 1;
+}
+
+// Perceptron: one row of int8 weights per hashed pc, dotted with the global history taken as
+// +1/-1 inputs. Weight 0 is the bias and sees a constant +1 input. Rows are padded with zero
+// inputs to whole 32 byte vectors so the dot product runs with SSSE3 or AVX2 when the host has
+// them, falling back to plain C otherwise.
+
+#define PERCEPTRON_MAX_HISTORY 255
+#define PERCEPTRON_VECTOR 32
+#define PERCEPTRON_WEIGHT_MAX 127 // symmetric, so negating a weight never overflows
+
+struct perceptron_predictor {
+  struct predictor base;
+  unsigned int mask;
+  unsigned int history;
+  unsigned int row;      // weights per perceptron, history + 1 rounded up to whole vectors
+  int threshold;         // train while the output magnitude is at most this
+  int8_t *weights;       // entries rows of row weights
+  int8_t *inputs;        // bias input, then history newest first, then zero padding
+  int (*dot)(const int8_t *w, const int8_t *x, unsigned int n);
+  void (*train)(int8_t *w, const int8_t *x, unsigned int n, int taken);
+  uint32_t pc; // of the last prediction, 1 when there is none
+  int output;
+};
+
+static int perceptron_dot_scalar(const int8_t *w, const int8_t *x, unsigned int n) {
+  int sum = 0;
+  for (unsigned int i = 0; i < n; i++)
+    sum += w[i] * x[i];
+  return sum;
+}
+
+static void perceptron_train_scalar(int8_t *w, const int8_t *x, unsigned int n, int taken) {
+  for (unsigned int i = 0; i < n; i++) {
+    int v = w[i] + (taken ? x[i] : -x[i]);
+    if (v > PERCEPTRON_WEIGHT_MAX)
+      v = PERCEPTRON_WEIGHT_MAX;
+    else if (v < -PERCEPTRON_WEIGHT_MAX)
+      v = -PERCEPTRON_WEIGHT_MAX;
+    w[i] = v;
+  }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// sign() applies the +1/-1/0 inputs to the weights, maddubs and madd widen the products to
+// 32-bit sums and the saturating add with a clamp keeps the weights in range while training.
+
+__attribute__((target("ssse3"))) static int perceptron_dot_ssse3(const int8_t *w,
+                                                                 const int8_t *x,
+                                                                 unsigned int n) {
+  const __m128i ones8 = _mm_set1_epi8(1);
+  const __m128i ones16 = _mm_set1_epi16(1);
+  __m128i sum = _mm_setzero_si128();
+  for (unsigned int i = 0; i < n; i += 16) {
+    __m128i p = _mm_sign_epi8(_mm_loadu_si128((const __m128i *)(w + i)),
+                              _mm_loadu_si128((const __m128i *)(x + i)));
+    sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_maddubs_epi16(ones8, p), ones16));
+  }
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+  return _mm_cvtsi128_si32(sum);
+}
+
+__attribute__((target("ssse3"))) static void perceptron_train_ssse3(int8_t *w, const int8_t *x,
+                                                                    unsigned int n, int taken) {
+  const __m128i direction = _mm_set1_epi8(taken ? 1 : -1);
+  const __m128i floor = _mm_set1_epi8(-PERCEPTRON_WEIGHT_MAX);
+  for (unsigned int i = 0; i < n; i += 16) {
+    __m128i step = _mm_sign_epi8(_mm_loadu_si128((const __m128i *)(x + i)), direction);
+    __m128i v = _mm_adds_epi8(_mm_loadu_si128((const __m128i *)(w + i)), step);
+    // SSE2 has no signed byte max, so raise -128 to -127 by comparison
+    v = _mm_sub_epi8(v, _mm_cmpgt_epi8(floor, v));
+    _mm_storeu_si128((__m128i *)(w + i), v);
+  }
+}
+
+__attribute__((target("avx2"))) static int perceptron_dot_avx2(const int8_t *w, const int8_t *x,
+                                                               unsigned int n) {
+  const __m256i ones8 = _mm256_set1_epi8(1);
+  const __m256i ones16 = _mm256_set1_epi16(1);
+  __m256i sum = _mm256_setzero_si256();
+  for (unsigned int i = 0; i < n; i += 32) {
+    __m256i p = _mm256_sign_epi8(_mm256_loadu_si256((const __m256i *)(w + i)),
+                                 _mm256_loadu_si256((const __m256i *)(x + i)));
+    sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_maddubs_epi16(ones8, p), ones16));
+  }
+  __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4e));
+  half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xb1));
+  return _mm_cvtsi128_si32(half);
+}
+
+__attribute__((target("avx2"))) static void perceptron_train_avx2(int8_t *w, const int8_t *x,
+                                                                  unsigned int n, int taken) {
+  const __m256i direction = _mm256_set1_epi8(taken ? 1 : -1);
+  const __m256i floor = _mm256_set1_epi8(-PERCEPTRON_WEIGHT_MAX);
+  for (unsigned int i = 0; i < n; i += 32) {
+    __m256i step = _mm256_sign_epi8(_mm256_loadu_si256((const __m256i *)(x + i)), direction);
+    __m256i v = _mm256_adds_epi8(_mm256_loadu_si256((const __m256i *)(w + i)), step);
+    _mm256_storeu_si256((__m256i *)(w + i), _mm256_max_epi8(v, floor));
+  }
+}
+#endif
+
+static struct predictor *perceptron_create(const struct predictor_params *params) {
+  if (params->entries == 0 || (params->entries & (params->entries - 1))) {
+    fprintf(stderr, "Predictor table size must be a power of two\n");
+    return NULL;
+  }
+  if (params->history < 1 || params->history > PERCEPTRON_MAX_HISTORY) {
+    fprintf(stderr, "Perceptron history must be 1-%d bits\n", PERCEPTRON_MAX_HISTORY);
+    return NULL;
+  }
+  struct perceptron_predictor *c = calloc(1, sizeof(struct perceptron_predictor));
+  c->mask = params->entries - 1;
+  c->history = params->history;
+  c->row = (params->history + PERCEPTRON_VECTOR) & ~(PERCEPTRON_VECTOR - 1);
+  // Jimenez and Lin's best threshold for a given history length
+  c->threshold = params->threshold ? (int)params->threshold : (int)(1.93 * params->history + 14);
+  c->weights = aligned_alloc(PERCEPTRON_VECTOR, (size_t)params->entries * c->row);
+  c->inputs = aligned_alloc(PERCEPTRON_VECTOR, c->row);
+  c->dot = perceptron_dot_scalar;
+  c->train = perceptron_train_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+  if (__builtin_cpu_supports("avx2")) {
+    c->dot = perceptron_dot_avx2;
+    c->train = perceptron_train_avx2;
+  } else if (__builtin_cpu_supports("ssse3")) {
+    c->dot = perceptron_dot_ssse3;
+    c->train = perceptron_train_ssse3;
+  }
+#endif
+  return &c->base;
+}
+
+static void perceptron_reset(struct predictor *p) {
+  struct perceptron_predictor *c = (struct perceptron_predictor *)p;
+  memset(c->weights, 0, (size_t)(c->mask + 1) * c->row);
+  // Empty history reads as not taken
+  memset(c->inputs, 0, c->row);
+  memset(c->inputs + 1, -1, c->history);
+  c->inputs[0] = 1;
+  c->pc = 1;
+}
+
+static void perceptron_destroy(struct predictor *p) {
+  struct perceptron_predictor *c = (struct perceptron_predictor *)p;
+  free(c->weights);
+  free(c->inputs);
+  free(c);
+}
+
+static inline int8_t *perceptron_row(struct perceptron_predictor *c, uint32_t pc) {
+  uint32_t a = pc >> 2;
+  return c->weights + (size_t)((a ^ (a >> 12)) & c->mask) * c->row;
+}
+
+static int perceptron_predict(struct predictor *p, uint32_t pc, int32_t imm) {
+  (void)imm;
+  struct perceptron_predictor *c = (struct perceptron_predictor *)p;
+  c->output = c->dot(perceptron_row(c, pc), c->inputs, c->row);
+  c->pc = pc;
+  return c->output >= 0;
+}
+
+static void perceptron_update(struct predictor *p, uint32_t pc, int32_t imm, int taken) {
+  (void)imm;
+  struct perceptron_predictor *c = (struct perceptron_predictor *)p;
+  int8_t *w = perceptron_row(c, pc);
+  int output = c->pc == pc ? c->output : c->dot(w, c->inputs, c->row);
+  c->pc = 1;
+  if ((output >= 0) != taken || abs(output) <= c->threshold)
+    c->train(w, c->inputs, c->row, taken);
+  memmove(c->inputs + 2, c->inputs + 1, c->history - 1);
+  c->inputs[1] = taken ? 1 : -1;
+}
+
+// Registry
+
+static const struct predictor_ops registry[] = {
+    {"nt", static_create, nt_predict, static_update, static_reset, static_destroy},
+    {"btfnt", static_create, btfnt_predict, static_update, static_reset, static_destroy},
+    {"bimodal", counter_create, bimodal_predict, bimodal_update, counter_reset, counter_destroy},
+    {"gshare", counter_create, gshare_predict, gshare_update, counter_reset, counter_destroy},
+    {"tage", tage_create, tage_predict, tage_update, tage_reset, tage_destroy},
+    {"perceptron", perceptron_create, perceptron_predict, perceptron_update, perceptron_reset,
+     perceptron_destroy},
+};
+
+#define NUM_PREDICTOR_TYPES (int)(sizeof(registry) / sizeof(registry[0]))
+
+const struct predictor_ops *predictor_lookup(const char *name) {
+  for (int i = 0; i < NUM_PREDICTOR_TYPES; i++) {
+    if (!strcmp(registry[i].name, name))
+      return &registry[i];
+  }
+  return NULL;
+}
+
+void predictor_list(FILE *out) {
+  for (int i = 0; i < NUM_PREDICTOR_TYPES; i++)
+    fprintf(out, "%s%s", i ? ", " : "", registry[i].name);
+  fprintf(out, "\n");
+}
+
+// Predictor sets
+
+struct predictor_set *predictor_set_create(void) {
+  return calloc(1, sizeof(struct predictor_set));
+}
+
+void predictor_set_delete(struct predictor_set *set) {
+  for (int i = 0; i < set->count; i++)
+    set->items[i]->ops->destroy(set->items[i]);
+  free(set->items);
+  free(set);
+}
+
+static int predictor_set_insert(struct predictor_set *set, const struct predictor_ops *ops,
+                                const struct predictor_params *params, const char *label) {
+  struct predictor *p = ops->create(params);
+  if (p == NULL)
+    return 0;
+  p->ops = ops;
+  snprintf(p->name, PREDICTOR_NAME_LEN, "%s", label);
+  p->ops->reset(p);
+  set->items = realloc(set->items, (set->count + 1) * sizeof(struct predictor *));
+  set->items[set->count++] = p;
+  return 1;
+}
+
+static void predictor_default_params(const struct predictor_ops *ops,
+                                     struct predictor_params *params) {
+  *params = (struct predictor_params){.entries = 1024, .history = 10, .max = 5, .name = ""};
+  if (ops->create == tage_create) {
+    params->history = 128;
+    params->tables = 7;
+    params->min_history = 4;
+    params->tag_bits = 9;
+  } else if (ops->create == perceptron_create) {
+    params->entries = 256;
+    params->history = 32;
+  }
+}
+
+int predictor_set_add(struct predictor_set *set, const char *spec) {
+  char type[PREDICTOR_NAME_LEN];
+  size_t type_len = strcspn(spec, ":");
+  if (type_len >= sizeof(type)) {
+    fprintf(stderr, "Unknown predictor '%s'\n", spec);
+    return 0;
+  }
+  memcpy(type, spec, type_len);
+  type[type_len] = '\0';
+  const struct predictor_ops *ops = predictor_lookup(type);
+  if (ops == NULL) {
+    fprintf(stderr, "Unknown predictor '%s'. Known predictors: ", type);
+    predictor_list(stderr);
+    return 0;
+  }
+
+  struct predictor_params params;
+  predictor_default_params(ops, &params);
+  const char *arg = spec[type_len] ? spec + type_len + 1 : spec + type_len;
+  while (*arg) {
+    char key[16];
+    size_t key_len = strcspn(arg, "=,");
+    if (arg[key_len] != '=' || key_len >= sizeof(key)) {
+      fprintf(stderr, "Malformed predictor parameter in '%s'\n", spec);
+      return 0;
+    }
+    memcpy(key, arg, key_len);
+    key[key_len] = '\0';
+    const char *value = arg + key_len + 1;
+    size_t value_len = strcspn(value, ",");
+    char *end;
+    unsigned long number = strtoul(value, &end, 0);
+    int numeric = end == value + value_len && value_len > 0;
+    if (!strcmp(key, "name") && value_len < PREDICTOR_NAME_LEN) {
+      memcpy(params.name, value, value_len);
+      params.name[value_len] = '\0';
+    } else if (!strcmp(key, "entries") && numeric) {
+      params.entries = number;
+    } else if (!strcmp(key, "history") && numeric) {
+      params.history = number;
+    } else if (!strcmp(key, "max") && numeric) {
+      params.max = number;
+    } else if (!strcmp(key, "tables") && numeric) {
+      params.tables = number;
+    } else if (!strcmp(key, "minhist") && numeric) {
+      params.min_history = number;
+    } else if (!strcmp(key, "tagbits") && numeric) {
+      params.tag_bits = number;
+    } else if (!strcmp(key, "threshold") && numeric) {
+      params.threshold = number;
+    } else if (!strcmp(key, "bits") && numeric && number >= 1 && number <= 8) {
+      params.max = (1u << number) - 1;
+    } else {
+      fprintf(stderr, "Bad predictor parameter '%s' in '%s'\n", key, spec);
+      return 0;
+    }
+    arg = value + value_len;
+    if (*arg == ',')
+      arg++;
+  }
+
+  char label[PREDICTOR_NAME_LEN];
+  if (params.name[0]) {
+    snprintf(label, sizeof(label), "%s", params.name);
+  } else {
+    // Upper case type name plus the parameters that matter for it
+    int n = 0;
+    for (const char *c = type; *c; c++)
+      label[n++] = (*c >= 'a' && *c <= 'z') ? *c - 'a' + 'A' : *c;
+    label[n] = '\0';
+    if (ops->create == counter_create || ops->create == perceptron_create)
+      snprintf(label + n, sizeof(label) - n, "-%u", params.entries);
+    if (ops->predict == gshare_predict || ops->create == perceptron_create)
+      snprintf(label + strlen(label), sizeof(label) - strlen(label), "-H%u", params.history);
+    if (ops->create == tage_create)
+      snprintf(label + n, sizeof(label) - n, "-%ux%u-H%u", params.tables, params.entries,
+               params.history);
+  }
+  return predictor_set_insert(set, ops, &params, label);
+}
+
+void predictor_set_add_defaults(struct predictor_set *set) {
+  struct predictor_params params;
+  predictor_default_params(predictor_lookup("gshare"), &params);
+  predictor_set_insert(set, predictor_lookup("nt"), &params, "NT");
+  predictor_set_insert(set, predictor_lookup("btfnt"), &params, "BTFNT");
+  predictor_set_insert(set, predictor_lookup("bimodal"), &params, "BIMODAL");
+  predictor_set_insert(set, predictor_lookup("gshare"), &params, "GSHARE");
+  predictor_default_params(predictor_lookup("tage"), &params);
+  predictor_set_insert(set, predictor_lookup("tage"), &params, "TAGE");
+  predictor_default_params(predictor_lookup("perceptron"), &params);
+  predictor_set_insert(set, predictor_lookup("perceptron"), &params, "PERCEPTRON");
+}
+
+void predictor_set_reset(struct predictor_set *set) {
+  for (int i = 0; i < set->count; i++) {
+    set->items[i]->ops->reset(set->items[i]);
+    set->items[i]->wrong = 0;
+  }
+}
+
+// Names are padded to the longest one, but never narrower than the other summary labels
+void predictor_set_print(struct predictor_set *set, FILE *out) {
+  int width = 11;
+  for (int i = 0; i < set->count; i++) {
+    int len = strlen(set->items[i]->name);
+    if (len > width)
+      width = len;
+  }
+  for (int i = 0; i < set->count; i++)
+    fprintf(out, "Wrong predictions %-*s: %ld\n", width, set->items[i]->name,
+            set->items[i]->wrong);
+}
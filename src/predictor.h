@@ -0,0 +1,95 @@
+#ifndef __PREDICTOR_H__
+#define __PREDICTOR_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Branch predictors behind a common interface. Every predictor sees every conditional branch:
+// it is asked for a prediction, charged a miss if it was wrong, and then updated.
+//
+// The pc handed to the predictors is the one the simulator has always indexed them with: the
+// pc after the branch has resolved.
+
+#define PREDICTOR_NAME_LEN 32
+
+struct predictor_params {
+  unsigned int entries;     // table entries, power of two (per tagged table for TAGE)
+  unsigned int history;     // global history bits (longest history for TAGE)
+  unsigned int max;         // saturating counter maximum; taken is predicted from (max + 1) / 2
+  unsigned int tables;      // TAGE: tagged tables
+  unsigned int min_history; // TAGE: shortest history
+  unsigned int tag_bits;    // TAGE: tag width
+  unsigned int threshold;   // perceptron: training threshold, 0 for 1.93 * history + 14
+  char name[PREDICTOR_NAME_LEN]; // label in the summary, generated when empty
+};
+
+struct predictor;
+
+struct predictor_ops {
+  const char *name; // registry name used on the command line
+  struct predictor *(*create)(const struct predictor_params *params);
+  int (*predict)(struct predictor *p, uint32_t pc, int32_t imm);
+  void (*update)(struct predictor *p, uint32_t pc, int32_t imm, int taken);
+  void (*reset)(struct predictor *p);
+  void (*destroy)(struct predictor *p);
+};
+
+// Common head of every predictor
+struct predictor {
+  const struct predictor_ops *ops;
+  char name[PREDICTOR_NAME_LEN];
+  long int wrong; // mispredictions since the last reset
+};
+
+// Look up a predictor type by name, NULL if unknown
+const struct predictor_ops *predictor_lookup(const char *name);
+// Print the registered predictor types
+void predictor_list(FILE *out);
+
+struct predictor_set {
+  int count;
+  struct predictor **items;
+};
+
+struct predictor_set *predictor_set_create(void);
+void predictor_set_delete(struct predictor_set *set);
+
+// Add a predictor from a spec "type[:key=value,...]" with keys entries, history, bits, max,
+// tables, minhist, tagbits, threshold and name. Reports to stderr and returns 0 if the spec is
+// invalid.
+int predictor_set_add(struct predictor_set *set, const char *spec);
+// The classic set: NT, BTFNT, 1024-entry bimodal and gshare with a 10-bit history, followed by
+// a TAGE with seven 1024-entry tables and histories of 4 to 128 branches and a 256-entry
+// perceptron over 32 branches of history
+void predictor_set_add_defaults(struct predictor_set *set);
+
+void predictor_set_reset(struct predictor_set *set);
+
+// Feed one branch outcome to every predictor
+static inline void predictor_set_record(struct predictor_set *set, uint32_t pc, int32_t imm,
+                                        int taken) {
+  for (int i = 0; i < set->count; i++) {
+    struct predictor *p = set->items[i];
+    if (p->ops->predict(p, pc, imm) != taken)
+      p->wrong++;
+    p->ops->update(p, pc, imm, taken);
+  }
+}
+
+// As predictor_set_record, also adding each predictor's miss to misses[i]
+static inline void predictor_set_record_misses(struct predictor_set *set, uint32_t pc,
+                                               int32_t imm, int taken, long int *misses) {
+  for (int i = 0; i < set->count; i++) {
+    struct predictor *p = set->items[i];
+    if (p->ops->predict(p, pc, imm) != taken) {
+      p->wrong++;
+      misses[i]++;
+    }
+    p->ops->update(p, pc, imm, taken);
+  }
+}
+
+// "Wrong predictions <name> : <count>" for every predictor
+void predictor_set_print(struct predictor_set *set, FILE *out);
+
+#endif
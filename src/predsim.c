@@ -0,0 +1,172 @@
+// predsim: evaluate branch predictors over an outcome dump written by sim -o, without
+// simulating the program again. The dump is mapped read-only and shared; the predictors are
+// dealt out to worker threads, each of which owns its predictors and replays the whole dump.
+// A branch trace written by sim -t is first decoded into a temporary dump and mapped the same
+// way, so memory use does not grow with the length of the trace.
+
+#include "btrace.h"
+#include "outcome.h"
+#include "predictor.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+struct shard {
+  pthread_t thread;
+  struct predictor_set set; // this thread's predictors, owned by the shared set
+  const uint32_t *records;
+  size_t count;
+};
+
+void terminate(const char *error) {
+  printf("%s\n", error);
+  printf("Branch predictor replay: Usage:\n");
+  printf("  predsim dump options\n");
+  printf("    dump: branch outcomes written by 'sim riscv-elf -o dump', or a branch\n");
+  printf("          trace written by 'sim riscv-elf -t trace'\n");
+  printf("    options:\n");
+  printf("      -b spec     // add a branch predictor, may be repeated. spec is\n");
+  printf("                  // type[:entries=N,history=N,bits=N,max=N,name=S]\n");
+  printf("                  // TAGE also takes tables=N,minhist=N,tagbits=N\n");
+  printf("                  // PERCEPTRON also takes threshold=N\n");
+  printf("                  // default: NT, BTFNT, BIMODAL, GSHARE, TAGE and\n");
+  printf("                  // PERCEPTRON\n");
+  printf("      -j threads  // worker threads, default one per online cpu\n");
+  exit(-1);
+}
+
+static void *shard_run(void *arg) {
+  struct shard *s = arg;
+  for (size_t i = 0; i < s->count; i++) {
+    uint32_t r = s->records[i];
+    predictor_set_record(&s->set, outcome_pc(r), outcome_imm(r), outcome_taken(r));
+  }
+  return NULL;
+}
+
+// Decode a branch trace into an unlinked temporary outcome dump and return a descriptor for it.
+// Outcome records hold the pc after the branch.
+static int trace_to_dump(struct btrace_reader *trace) {
+  FILE *file = tmpfile();
+  if (file == NULL) {
+    perror("Temporary outcome dump");
+    exit(-1);
+  }
+  int fd = dup(fileno(file));
+  struct outcome_writer *w = outcome_create_file(file);
+  struct btrace_record rec;
+  while (btrace_read(trace, &rec)) {
+    uint32_t next = rec.taken ? rec.target : rec.pc + 4;
+    outcome_write(w, next, rec.target - rec.pc, rec.taken);
+  }
+  if (fd < 0 || outcome_close(w) < 0) {
+    fprintf(stderr, "Error writing temporary outcome dump\n");
+    exit(-1);
+  }
+  return fd;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2)
+    terminate("Missing operands");
+  struct predictor_set *predictors = predictor_set_create();
+  long int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  for (int arg = 2; arg < argc; ++arg) {
+    const char *opt = argv[arg];
+    if (arg + 1 >= argc)
+      terminate("Missing operands");
+    const char *value = argv[++arg];
+    if (!strcmp(opt, "-b")) {
+      if (!predictor_set_add(predictors, value))
+        terminate("Bad predictor specification");
+    } else if (!strcmp(opt, "-j")) {
+      char *end;
+      threads = strtol(value, &end, 0);
+      if (*end || threads < 1)
+        terminate("Bad thread count");
+    } else {
+      terminate("Unknown option");
+    }
+  }
+  if (predictors->count == 0)
+    predictor_set_add_defaults(predictors);
+  if (threads > predictors->count)
+    threads = predictors->count;
+
+  int fd;
+  struct btrace_reader *trace = btrace_open(argv[1]);
+  if (trace) {
+    fd = trace_to_dump(trace);
+    btrace_reader_close(trace);
+  } else {
+    fd = open(argv[1], O_RDONLY);
+  }
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    perror(argv[1]);
+    exit(-1);
+  }
+  const unsigned char *data = NULL;
+  if (st.st_size > 0) {
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      perror(argv[1]);
+      exit(-1);
+    }
+  }
+  close(fd);
+  if (st.st_size < OUTCOME_HEADER_SIZE || memcmp(data, "RVBO", 4) ||
+      data[4] != OUTCOME_VERSION || (st.st_size - OUTCOME_HEADER_SIZE) % sizeof(uint32_t)) {
+    fprintf(stderr, "%s is not a branch outcome dump\n", argv[1]);
+    exit(-1);
+  }
+  const uint32_t *records = (const uint32_t *)(data + OUTCOME_HEADER_SIZE);
+  size_t count = (st.st_size - OUTCOME_HEADER_SIZE) / sizeof(uint32_t);
+  madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+
+  // Deal the predictors out round-robin so the expensive ones spread over the threads
+  predictor_set_reset(predictors);
+  struct shard *shards = calloc(threads, sizeof(struct shard));
+  for (int t = 0; t < threads; t++) {
+    shards[t].set.items = malloc(predictors->count * sizeof(struct predictor *));
+    shards[t].records = records;
+    shards[t].count = count;
+  }
+  for (int i = 0; i < predictors->count; i++) {
+    struct shard *s = &shards[i % threads];
+    s->set.items[s->set.count++] = predictors->items[i];
+  }
+
+  struct timespec before, after;
+  clock_gettime(CLOCK_MONOTONIC, &before);
+  for (int t = 1; t < threads; t++) {
+    if (pthread_create(&shards[t].thread, NULL, shard_run, &shards[t])) {
+      perror("pthread_create");
+      exit(-1);
+    }
+  }
+  shard_run(&shards[0]);
+  for (int t = 1; t < threads; t++)
+    pthread_join(shards[t].thread, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &after);
+  double seconds = (after.tv_sec - before.tv_sec) + (after.tv_nsec - before.tv_nsec) / 1e9;
+
+  printf("Total branches executed      : %zu\n", count);
+  predictor_set_print(predictors, stdout);
+  printf("\nReplayed %zu branches through %d predictors on %ld threads in %f s\n", count,
+         predictors->count, threads, seconds);
+
+  for (int t = 0; t < threads; t++)
+    free(shards[t].set.items);
+  free(shards);
+  if (data)
+    munmap((void *)data, st.st_size);
+  predictor_set_delete(predictors);
+  return 0;
+}
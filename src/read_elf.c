@@ -1,159 +1,213 @@
 #include "read_elf.h"
 #include "disassemble.h"
 
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "elf.h"
 
-int read_elf(struct memory* mem, struct program_info* info, const char *filename, FILE *log_file) {
-    FILE *file = fopen(filename, "rb");
-    if (!file) {
-        fprintf(log_file, "Error opening file");
-        return -1;
+struct elf_file {
+    int fd;
+    const unsigned char* data;
+    size_t size;
+};
+
+struct elf_file* elf_open(const char* file_name) {
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        perror("Error opening file");
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Elf32_Ehdr)) {
+        fprintf(stderr, "Elf file error, file shorter than minimal header size.\n");
+        close(fd);
+        return NULL;
+    }
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        perror("Error mapping file");
+        close(fd);
+        return NULL;
     }
+    // Check for ELF magic number
+    if (memcmp(((const Elf32_Ehdr*)data)->e_ident, ELFMAG, SELFMAG) != 0) {
+        fprintf(stderr, "Not a valid ELF file.\n");
+        munmap(data, st.st_size);
+        close(fd);
+        return NULL;
+    }
+    struct elf_file* elf = malloc(sizeof(struct elf_file));
+    elf->fd = fd;
+    elf->data = data;
+    elf->size = st.st_size;
+    return elf;
+}
 
-    // Read the ELF header
-    Elf32_Ehdr elf_header;
-    unsigned stat = fread(&elf_header, 1, sizeof(Elf32_Ehdr), file);
-    if (stat != sizeof(Elf32_Ehdr)) {
-        fprintf(log_file, "Elf file error, file shorter than minimal header size.\n");
-        fclose(file);
-        return -1;
+void elf_close(struct elf_file* elf) {
+    munmap((void*)elf->data, elf->size);
+    close(elf->fd);
+    free(elf);
+}
+
+// Check that [offset, offset + size) lies inside the file
+static int elf_contains(const struct elf_file* elf, size_t offset, size_t size) {
+    return offset <= elf->size && size <= elf->size - offset;
+}
+
+// Place file bytes [offset, offset + size) at guest address vaddr. Whole host pages of
+// read-only segments are mapped copy-on-write straight from the file when the memory model
+// allows it; everything else is copied out of the file mapping.
+static void load_segment(struct memory* mem, const struct elf_file* elf, unsigned int vaddr,
+                         unsigned int offset, unsigned int size, int read_only) {
+    if (read_only) {
+        unsigned int page_size = sysconf(_SC_PAGESIZE);
+        unsigned int head = (page_size - (vaddr % page_size)) % page_size;
+        unsigned int body = head < size ? (size - head) / page_size * page_size : 0;
+        if (body && (vaddr - offset) % page_size == 0 &&
+            memory_map_file(mem, vaddr + head, elf->fd, offset + head, body)) {
+            memory_write_block(mem, vaddr, elf->data + offset, head);
+            unsigned int tail = head + body;
+            memory_write_block(mem, vaddr + tail, elf->data + offset + tail, size - tail);
+            return;
+        }
     }
+    memory_write_block(mem, vaddr, elf->data + offset, size);
+}
 
-    // Check for ELF magic number
-    if (memcmp(elf_header.e_ident, ELFMAG, SELFMAG) != 0) {
-        fprintf(log_file, "Not a valid ELF file.\n");
-        fclose(file);
+int read_elf(struct memory* mem, struct program_info* info, struct elf_file* elf) {
+    // Read the ELF header
+    const Elf32_Ehdr* elf_header = (const Elf32_Ehdr*)elf->data;
+
+    // Program header table
+    if (!elf_contains(elf, elf_header->e_phoff, elf_header->e_phnum * sizeof(Elf32_Phdr))) {
+        fprintf(stderr, "Elf file error, file shorter than minimal prog header size.\n");
         return -1;
     }
-
-    // Seek to the program header table and read program headers
+    const Elf32_Phdr* program_headers = (const Elf32_Phdr*)(elf->data + elf_header->e_phoff);
     info->text_start = 0;
     info->text_end = 0;
-    info->start = elf_header.e_entry;
-    //printf("Program headers starting at offset %d\n", elf_header.e_phoff);
-    //printf("Program entry point address: 0x%x\n", info->start);
-    //printf("Text offset 0x%x\n\n", info->text_start);
-    Elf32_Phdr program_header;
-    for (int i = 0; i < elf_header.e_phnum; i++) {
-        fseek(file, elf_header.e_phoff + i * sizeof(Elf32_Phdr), SEEK_SET);
-        stat = fread(&program_header, 1, sizeof(Elf32_Phdr), file);
-        if (stat != sizeof(Elf32_Phdr)) {
-            fprintf(log_file, "Elf file error, file shorter than minimal prog header size.\n");
-            fclose(file);
-            return -1;
-        }
+    info->start = elf_header->e_entry;
+    for (int i = 0; i < elf_header->e_phnum; i++) {
+        const Elf32_Phdr* program_header = &program_headers[i];
 
         // Check for loadable segments (PT_LOAD)
-        if (program_header.p_type == PT_LOAD) {
-            // const char *segment_type = NULL;
-
+        if (program_header->p_type == PT_LOAD) {
             // Identify segment type
-            if (program_header.p_flags & PF_X) {
-                // segment_type = "Executable (.text)";
-                info->text_start = program_header.p_vaddr + (unsigned int)(sizeof(Elf32_Ehdr) + elf_header.e_phnum * sizeof(Elf32_Phdr));
-                info->text_end = program_header.p_vaddr + program_header.p_filesz;
-            } else if (program_header.p_flags & PF_W) {
-                // segment_type = "Writable (static data)";
-            } else {
-                // segment_type = "Read-only (e.g., .rodata)";
-            }
-
-            //printf("Found %s segment at offset 0x%x, size 0x%x, in-memory address 0x%x\n",
-            //      segment_type, program_header.p_offset, program_header.p_filesz, program_header.p_vaddr);
-
-            // Allocate buffer for the segment
-            unsigned char *segment_data = malloc(program_header.p_filesz);
-            if (!segment_data) {
-                fprintf(log_file, "Error allocating memory for segment\n");
-                fclose(file);
-                return -1;
+            if (program_header->p_flags & PF_X) {
+                // Executable (.text)
+                info->text_start = program_header->p_vaddr + (unsigned int)(sizeof(Elf32_Ehdr) + elf_header->e_phnum * sizeof(Elf32_Phdr));
+                info->text_end = program_header->p_vaddr + program_header->p_filesz;
             }
 
-            // Read the segment data
-            fseek(file, program_header.p_offset, SEEK_SET);
-            stat = fread(segment_data, 1, program_header.p_filesz, file);
-            if (stat != program_header.p_filesz) {
-                fprintf(log_file, "Error reading segment - failed to read entire segment in one go\n");
+            if (!elf_contains(elf, program_header->p_offset, program_header->p_filesz)) {
+                fprintf(stderr, "Error reading segment - segment extends past end of file\n");
                 return -1;
             }
 
-            // Process the segment data (e.g., print or analyze)
-            // printf("All bytes of %s segment:\n", segment_type);
-            for (unsigned int j = 0; j < program_header.p_filesz; j++) {
-                // printf("%02x ", segment_data[j]);
-                memory_wr_b(mem, program_header.p_vaddr + j, segment_data[j]);
+            // Copy (or map) the segment into simulated memory and zero the rest of it (.bss)
+            load_segment(mem, elf, program_header->p_vaddr, program_header->p_offset,
+                         program_header->p_filesz, !(program_header->p_flags & PF_W));
+            if (program_header->p_memsz > program_header->p_filesz) {
+                memory_zero_block(mem, program_header->p_vaddr + program_header->p_filesz,
+                                  program_header->p_memsz - program_header->p_filesz);
             }
-            /*
-            printf("\n\nDisassembly\n");
-            for (unsigned int j = info->text_start; j < program_header.p_filesz; j += 4) {
-                unsigned int addr = program_header.p_vaddr + j;
-                int inst = memory_rd_w(mem, addr);
-                const int buf_sz = 64;
-                char buf[buf_sz];
-                decode_rv32i(addr, inst, buf, buf_sz);
-                // printf("%6x %8x   %s\n", j, inst, buf);
-            }
-            printf("\n");
-            */
-            free(segment_data);
         }
     }
-    // adjust program info to virtual addresses instead of file offsets
-    fclose(file);
     return 0;
 }
 
+// The symbol and string tables are used in place inside the file mapping. Two indexes are
+// built over them when the table is read:
+// - a hash from value to the first bound symbol with that value (open addressing, linear
+//   probing), so exact lookups return what a scan in table order would
+// - the sized function symbols sorted by address, for "which function holds this address"
+struct symbol_slot {
+    unsigned int value;
+    int index; // into the symbol table, -1 for an empty slot
+};
+
+struct symbol_range {
+    unsigned int start;
+    unsigned int end; // one past the last byte
+    const char* name;
+};
+
 struct symbols {
-    char* strtab;
-    Elf32_Sym* symbols;
+    const char* strtab;
+    const Elf32_Sym* symbols;
     int num_symbols;
+    struct symbol_slot* slots;
+    unsigned int slot_mask; // capacity - 1, capacity a power of two
+    struct symbol_range* ranges;
+    int num_ranges;
 };
 
-struct symbols* symbols_read_from_elf(const char *filename) {
-    FILE *file = fopen(filename, "rb");
-    if (!file) {
-        perror("Error opening file");
-        return NULL;
-    }
+static struct symbol_slot* symbols_slot(struct symbols* symbols, unsigned int value) {
+    unsigned int slot = (value * 0x9e3779b1u) >> 8 & symbols->slot_mask;
+    while (symbols->slots[slot].index >= 0 && symbols->slots[slot].value != value)
+        slot = (slot + 1) & symbols->slot_mask;
+    return &symbols->slots[slot];
+}
 
-    // Read the ELF header
-    Elf32_Ehdr elf_header;
-    int status = fread(&elf_header, 1, sizeof(Elf32_Ehdr), file);
-    if (status != sizeof(Elf32_Ehdr)) {
-        fprintf(stderr, "Not a valid ELF file.\n");
-        fclose(file);
-        return NULL;
-    }
+static int symbols_compare_ranges(const void* a, const void* b) {
+    const struct symbol_range* x = a;
+    const struct symbol_range* y = b;
+    return (x->start > y->start) - (x->start < y->start);
+}
 
-    // Check for ELF magic number
-    if (memcmp(elf_header.e_ident, ELFMAG, SELFMAG) != 0) {
-        fprintf(stderr, "Not a valid ELF file.\n");
-        fclose(file);
-        return NULL;
+static void symbols_build_index(struct symbols* symbols) {
+    unsigned int capacity = 16;
+    while (capacity < 2 * (unsigned int)symbols->num_symbols)
+        capacity *= 2;
+    symbols->slot_mask = capacity - 1;
+    symbols->slots = malloc(capacity * sizeof(struct symbol_slot));
+    for (unsigned int i = 0; i < capacity; i++)
+        symbols->slots[i].index = -1;
+    symbols->ranges = malloc((symbols->num_symbols + 1) * sizeof(struct symbol_range));
+    symbols->num_ranges = 0;
+
+    for (int i = 0; i < symbols->num_symbols; i++) {
+        const Elf32_Sym* sym = &symbols->symbols[i];
+        if (!ELF32_ST_BIND(sym->st_info))
+            continue;
+        struct symbol_slot* slot = symbols_slot(symbols, sym->st_value);
+        if (slot->index < 0) {
+            slot->value = sym->st_value;
+            slot->index = i;
+        }
+        if (ELF32_ST_TYPE(sym->st_info) == STT_FUNC && sym->st_size) {
+            struct symbol_range* range = &symbols->ranges[symbols->num_ranges++];
+            range->start = sym->st_value;
+            range->end = sym->st_value + sym->st_size;
+            range->name = &symbols->strtab[sym->st_name];
+        }
     }
+    qsort(symbols->ranges, symbols->num_ranges, sizeof(struct symbol_range),
+          symbols_compare_ranges);
+}
 
-    // Seek to the section header table
-    fseek(file, elf_header.e_shoff, SEEK_SET);
+struct symbols* symbols_read_from_elf(struct elf_file* elf) {
+    const Elf32_Ehdr* elf_header = (const Elf32_Ehdr*)elf->data;
 
-    // Read all section headers
-    Elf32_Shdr *section_headers = malloc(elf_header.e_shnum * sizeof(Elf32_Shdr));
-    status = fread(section_headers, elf_header.e_shnum, sizeof(Elf32_Shdr), file);
-    if (status != sizeof(Elf32_Shdr)) {
+    // Section header table
+    if (!elf_contains(elf, elf_header->e_shoff, elf_header->e_shnum * sizeof(Elf32_Shdr))) {
         fprintf(stderr, "While reading ELF file: Invalid section header.\n");
-        fclose(file);
         return NULL;
     }
+    const Elf32_Shdr* section_headers = (const Elf32_Shdr*)(elf->data + elf_header->e_shoff);
 
     // Locate the symbol table and the string table
-    Elf32_Shdr *symtab_section = NULL;
-    Elf32_Shdr *strtab_section = NULL;
-    for (int i = 0; i < elf_header.e_shnum; i++) {
+    const Elf32_Shdr* symtab_section = NULL;
+    const Elf32_Shdr* strtab_section = NULL;
+    for (int i = 0; i < elf_header->e_shnum; i++) {
         if (section_headers[i].sh_type == SHT_SYMTAB) {
             symtab_section = &section_headers[i];
-        } else if (section_headers[i].sh_type == SHT_STRTAB && i != elf_header.e_shstrndx) {
+        } else if (section_headers[i].sh_type == SHT_STRTAB && i != elf_header->e_shstrndx) {
             // Avoid the section header string table
             strtab_section = &section_headers[i];
         }
@@ -161,69 +215,55 @@ struct symbols* symbols_read_from_elf(const char *filename) {
 
     if (!symtab_section || !strtab_section) {
         fprintf(stderr, "No symbol table found.\n");
-        free(section_headers);
-        fclose(file);
         return NULL;
     }
-
-    struct symbols* symbols = malloc(sizeof(struct symbols));
-    // Read the string table
-    symbols->strtab = malloc(strtab_section->sh_size);
-    fseek(file, strtab_section->sh_offset, SEEK_SET);
-    status = fread(symbols->strtab, 1, strtab_section->sh_size, file);
-    if ((unsigned int)status != strtab_section->sh_size) {
+    if (!elf_contains(elf, strtab_section->sh_offset, strtab_section->sh_size)) {
         fprintf(stderr, "Error, unable to read string table in one go.\n");
-        fclose(file);
         return NULL;
     }
-
-    // Read the symbol table entries
-    symbols->num_symbols = symtab_section->sh_size / sizeof(Elf32_Sym);
-    symbols->symbols = malloc(symtab_section->sh_size);
-    fseek(file, symtab_section->sh_offset, SEEK_SET);
-    status = fread(symbols->symbols, symbols->num_symbols, sizeof(Elf32_Sym), file);
-    if (status != sizeof(Elf32_Sym)) {
+    if (!elf_contains(elf, symtab_section->sh_offset, symtab_section->sh_size) ||
+        symtab_section->sh_offset % sizeof(Elf32_Word)) {
         fprintf(stderr, "Error, unable to read symbol table entry.\n");
-        fclose(file);
         return NULL;
     }
 
-    // Print symbols
-    /* printf("Symbols:\n");
-    for (int i = 0; i < symbols->num_symbols; i++) {
-        const char *name = &symbols->strtab[symbols->symbols[i].st_name];
-        printf("Name: %-50s Address: 0x%-8x Size: %3d Type: %2d Binding: %2d\n",
-               name,
-               symbols->symbols[i].st_value,
-               symbols->symbols[i].st_size,
-               ELF32_ST_TYPE(symbols->symbols[i].st_info),
-               ELF32_ST_BIND(symbols->symbols[i].st_info));
-    }
-    */
-    // Free allocated memory
-    // free(strtab);
-    // free(symbols);
-    free(section_headers);
-    fclose(file);
+    struct symbols* symbols = malloc(sizeof(struct symbols));
+    symbols->strtab = (const char*)(elf->data + strtab_section->sh_offset);
+    symbols->symbols = (const Elf32_Sym*)(elf->data + symtab_section->sh_offset);
+    symbols->num_symbols = symtab_section->sh_size / sizeof(Elf32_Sym);
+    symbols_build_index(symbols);
     return symbols;
 }
 
 
 const char* symbols_value_to_sym(struct symbols* symbols, unsigned int value) 
 {
-    for (int i = 0; i < symbols->num_symbols; i++) {
-        if (symbols->symbols[i].st_value == value && ELF32_ST_BIND(symbols->symbols[i].st_info)) {
-            return &symbols->strtab[symbols->symbols[i].st_name];
-        }
+    struct symbol_slot* slot = symbols_slot(symbols, value);
+    if (slot->index < 0)
+        return NULL;
+    return &symbols->strtab[symbols->symbols[slot->index].st_name];
+}
+
+const char* symbols_addr_to_func(struct symbols* symbols, unsigned int addr, unsigned int* offset)
+{
+    // Binary search for the last function starting at or below addr
+    int low = 0, high = symbols->num_ranges;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (symbols->ranges[mid].start <= addr)
+            low = mid + 1;
+        else
+            high = mid;
     }
-    return NULL;
+    if (low == 0 || addr >= symbols->ranges[low - 1].end)
+        return NULL;
+    *offset = addr - symbols->ranges[low - 1].start;
+    return symbols->ranges[low - 1].name;
 }
 
 void symbols_delete(struct symbols* symbols)
 {
-    free(symbols->strtab);
-    free(symbols->symbols);
+    free(symbols->slots);
+    free(symbols->ranges);
     free(symbols);
 }
-
-
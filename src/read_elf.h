@@ -11,15 +11,23 @@ struct program_info {
     unsigned int start;
 };
 
-// read file into simulated memory, fill in program info
-int read_elf(struct memory* mem, struct program_info* info, const char* file_name, FILE *log_file);
+// An ELF file mapped into the simulator's address space once and shared by the loader and
+// the symbol table. It must stay open while symbols read from it are in use.
+struct elf_file;
+
+// map/unmap an elf file (returns NULL and reports to stderr on error)
+struct elf_file* elf_open(const char* file_name);
+void elf_close(struct elf_file* elf);
+
+// load the file into simulated memory, fill in program info
+int read_elf(struct memory* mem, struct program_info* info, struct elf_file* elf);
 
 // You can use the following functions to "pretty-print" numbers as symbols in case matching
 // symbol definitions exist in the elf file. Doing so is entirely optional.
 struct symbols;
 
 // read symbol table from elf file
-struct symbols* symbols_read_from_elf(const char* file_name);
+struct symbols* symbols_read_from_elf(struct elf_file* elf);
 
 // delete symbol table after use
 void symbols_delete(struct symbols* symbols);
@@ -27,5 +35,9 @@ void symbols_delete(struct symbols* symbols);
 // map a value to a symbol (return NULL if no matching symbol found)
 const char* symbols_value_to_sym(struct symbols* symbols, unsigned int value);
 
+// map an address to the function containing it and the offset into it (return NULL if no
+// function symbol covers the address)
+const char* symbols_addr_to_func(struct symbols* symbols, unsigned int addr, unsigned int* offset);
+
 
 #endif
@@ -0,0 +1,51 @@
+// simlog: render a binary instruction log written by sim -L as the text sim -l writes.
+
+#include "binlog.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define READ_RECORDS 65536
+
+void terminate(const char *error) {
+  printf("%s\n", error);
+  printf("Binary instruction log renderer: Usage:\n");
+  printf("  simlog binlog [text]\n");
+  printf("    binlog: log written by 'sim riscv-elf -L binlog'\n");
+  printf("    text: file to write, default stdout\n");
+  exit(-1);
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 2 || argc > 3)
+    terminate("Missing operands");
+  FILE *in = fopen(argv[1], "rb");
+  if (in == NULL)
+    terminate("Could not open binary log");
+  unsigned char header[BINLOG_HEADER_SIZE];
+  if (fread(header, 1, sizeof(header), in) != sizeof(header) || memcmp(header, "RVBL", 4) ||
+      header[4] != BINLOG_VERSION || header[5] != sizeof(struct binlog_record))
+    terminate("Not a binary instruction log from this version of sim");
+  FILE *out = stdout;
+  if (argc == 3) {
+    out = fopen(argv[2], "w");
+    if (out == NULL)
+      terminate("Could not open output file");
+  }
+  struct binlog_record *records = malloc(READ_RECORDS * sizeof(struct binlog_record));
+  struct disasm_cache *cache = disasm_cache_create();
+  int previous_flag = 0;
+  size_t count;
+  while ((count = fread(records, sizeof(struct binlog_record), READ_RECORDS, in)) > 0) {
+    for (size_t i = 0; i < count; i++) {
+      binlog_render(cache, &records[i], previous_flag, out);
+      previous_flag = records[i].flag;
+    }
+  }
+  disasm_cache_delete(cache);
+  free(records);
+  fclose(in);
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}
@@ -1,19 +1,30 @@
 #include "simulate.h"
 #include "common.h"
+#include "jit.h"
+#include "logwriter.h"
+#include "predictor.h"
 #include "memory.h"
 #include "read_elf.h"
 #include "string.h"
+#include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 
-#define BUFFSIZE 120
 #define SMALLBUFFSIZE 50
 
 struct CPU cpu = {0};
 
 int last_branch_outcome = 0;
-unsigned char bimodal[1024];
-unsigned int ghr = 0;
-unsigned char gshare_table[1024];
+static struct predictor_set *predictors = NULL;
+static struct predictor_sweep *sweep = NULL;
+static struct btrace_writer *trace = NULL;
+static struct outcome_writer *outcomes = NULL;
+static struct btb *btb = NULL;
+static struct bprofile *profile = NULL;
+static struct eprofile *exec_profile = NULL;
+static struct binlog *binlog = NULL;
+static struct log_writer *text_log = NULL; // -l writer thread while run_switch() is running
 
 int load_word_from_memory(void) { return (memory_rd_w(cpu.mem, cpu.pc)); }
 
@@ -87,7 +98,7 @@ void mulu(int dest, int reg1, int reg2) {
   cpu.registers[dest] = result;
 }
 
-void div(int dest, int reg1, int reg2) {
+void divs(int dest, int reg1, int reg2) {
   int32_t result = (int32_t)cpu.registers[reg1] / (int32_t)cpu.registers[reg2];
   cpu.registers[dest] = result;
 }
@@ -281,19 +292,237 @@ void jal(int dest, int imm) {
   cpu.pc += (int32_t)imm;
 }
 
+// Guest console output is collected here rather than handed to putchar one character at a
+// time. The buffer is flushed when full, at newlines when stdout is a terminal, before the
+// guest reads input and whenever the simulator itself prints or the simulation ends.
+#define GUEST_CONSOLE_SIZE 65536
+
+static char guest_console[GUEST_CONSOLE_SIZE];
+static size_t guest_console_len = 0;
+static int guest_console_tty = 0;
+
+static void guest_console_flush(void) {
+  if (guest_console_len) {
+    fwrite(guest_console, 1, guest_console_len, stdout);
+    guest_console_len = 0;
+  }
+  fflush(stdout);
+}
+
+// A memory fault ends the process in the middle of an instruction; this saves what the run has
+// produced so far before memory_unaligned() exits
+static void simulate_fault(void) {
+  guest_console_flush();
+  if (binlog)
+    binlog_flush(binlog);
+  // Drain and stop the writer thread, so it is not formatting into the log during exit()
+  if (text_log) {
+    log_writer_finish(text_log);
+    text_log = NULL;
+  }
+}
+
+static void guest_console_write(const char *text, size_t len) {
+  while (len) {
+    size_t room = GUEST_CONSOLE_SIZE - guest_console_len;
+    size_t n = len < room ? len : room;
+    memcpy(guest_console + guest_console_len, text, n);
+    guest_console_len += n;
+    text += n;
+    len -= n;
+    if (guest_console_len == GUEST_CONSOLE_SIZE ||
+        (guest_console_tty && memchr(text - n, '\n', n)))
+      guest_console_flush();
+  }
+}
+
+// write_string(s): copy the NUL terminated guest string in blocks; returns its length
+static int guest_write_string(uint32_t addr) {
+  char chunk[256];
+  size_t total = 0;
+  for (;;) {
+    memory_read_block(cpu.mem, addr + total, chunk, sizeof(chunk));
+    char *end = memchr(chunk, '\0', sizeof(chunk));
+    size_t n = end ? (size_t)(end - chunk) : sizeof(chunk);
+    guest_console_write(chunk, n);
+    total += n;
+    if (end)
+      return total;
+  }
+}
+
+// Guest files for the benchmark runtime's ecalls 4-6 and 8. Handles 0-2 are the simulator's own
+// standard streams; opened files get handles from 3 up. Buffers move between the host file and
+// guest memory in blocks, never a word at a time.
+#define GUEST_MAX_FILES 16
+#define GUEST_FIRST_HANDLE 3
+#define GUEST_NUM_HANDLES (GUEST_FIRST_HANDLE + GUEST_MAX_FILES)
+#define GUEST_PATH_MAX 4096
+#define GUEST_IO_CHUNK 65536
+
+struct guest_file {
+  int fd; // host fd, -1 when free
+  // Bytes of an int cut off by the end of a read, handed out first by the next read. Kept here
+  // rather than seeking back, which pipes and terminals cannot do.
+  unsigned char partial[3];
+  int partial_len;
+};
+
+static struct guest_file guest_files[GUEST_NUM_HANDLES]; // indexed by handle
+
+static void guest_files_init(void) {
+  for (int i = 0; i < GUEST_NUM_HANDLES; i++) {
+    guest_files[i].fd = i < GUEST_FIRST_HANDLE ? i : -1;
+    guest_files[i].partial_len = 0;
+  }
+}
+
+static void guest_files_close_all(void) {
+  for (int i = GUEST_FIRST_HANDLE; i < GUEST_NUM_HANDLES; i++) {
+    if (guest_files[i].fd >= 0)
+      close(guest_files[i].fd);
+  }
+  guest_files_init();
+}
+
+// The open file behind a guest handle, NULL if there is none
+static struct guest_file *guest_file(int handle) {
+  if (handle < 0 || handle >= GUEST_NUM_HANDLES || guest_files[handle].fd < 0)
+    return NULL;
+  return &guest_files[handle];
+}
+
+// open_file(path, flags) with fopen style flags; returns a handle or -1
+static int guest_open(uint32_t path_addr, uint32_t flags_addr) {
+  char path[GUEST_PATH_MAX];
+  char mode[4];
+  for (size_t i = 0; i < sizeof(path); i++) {
+    path[i] = memory_rd_b(cpu.mem, path_addr + i);
+    if (path[i] == '\0')
+      break;
+    if (i == sizeof(path) - 1)
+      return -1;
+  }
+  for (size_t i = 0; i < sizeof(mode); i++) {
+    mode[i] = memory_rd_b(cpu.mem, flags_addr + i);
+    if (mode[i] == '\0')
+      break;
+  }
+  mode[sizeof(mode) - 1] = '\0';
+  int plus = strchr(mode, '+') != NULL;
+  int oflags;
+  if (mode[0] == 'r')
+    oflags = plus ? O_RDWR : O_RDONLY;
+  else if (mode[0] == 'w')
+    oflags = (plus ? O_RDWR : O_WRONLY) | O_CREAT | O_TRUNC;
+  else if (mode[0] == 'a')
+    oflags = (plus ? O_RDWR : O_WRONLY) | O_CREAT | O_APPEND;
+  else
+    return -1;
+  for (int i = GUEST_FIRST_HANDLE; i < GUEST_NUM_HANDLES; i++) {
+    if (guest_files[i].fd < 0) {
+      guest_files[i].fd = open(path, oflags, 0644);
+      guest_files[i].partial_len = 0;
+      return guest_files[i].fd < 0 ? -1 : i;
+    }
+  }
+  return -1;
+}
+
+static int guest_close(int handle) {
+  struct guest_file *f = guest_file(handle);
+  if (f == NULL)
+    return -1;
+  f->partial_len = 0;
+  if (handle < GUEST_FIRST_HANDLE)
+    return 0;
+  int fd = f->fd;
+  f->fd = -1;
+  return close(fd);
+}
+
+// read_int_buffer(handle, buffer, max): whole ints read, 0 at end of file, -1 on error
+static int guest_read_ints(int handle, uint32_t buffer, int max) {
+  struct guest_file *f = guest_file(handle);
+  if (f == NULL || max < 0)
+    return -1;
+  if (max == 0)
+    return 0;
+  size_t wanted = (size_t)max * 4;
+  size_t done = f->partial_len;
+  memory_write_block(cpu.mem, buffer, f->partial, done);
+  char *chunk = malloc(GUEST_IO_CHUNK);
+  while (done < wanted) {
+    size_t len = wanted - done < GUEST_IO_CHUNK ? wanted - done : GUEST_IO_CHUNK;
+    ssize_t got = read(f->fd, chunk, len);
+    if (got <= 0)
+      break;
+    memory_write_block(cpu.mem, buffer + done, chunk, got);
+    done += got;
+  }
+  free(chunk);
+  // Keep a trailing partial int for the next read
+  f->partial_len = done % 4;
+  memory_read_block(cpu.mem, buffer + done - f->partial_len, f->partial, f->partial_len);
+  return done / 4;
+}
+
+// write_int_buffer(handle, buffer, size): ints written or -1
+static int guest_write_ints(int handle, uint32_t buffer, int size) {
+  struct guest_file *f = guest_file(handle);
+  if (f == NULL || size < 0)
+    return -1;
+  int fd = f->fd;
+  if (fd == STDOUT_FILENO)
+    guest_console_flush();
+  char *chunk = malloc(GUEST_IO_CHUNK);
+  size_t wanted = (size_t)size * 4;
+  size_t done = 0;
+  while (done < wanted) {
+    size_t len = wanted - done < GUEST_IO_CHUNK ? wanted - done : GUEST_IO_CHUNK;
+    memory_read_block(cpu.mem, buffer + done, chunk, len);
+    ssize_t put = write(fd, chunk, len);
+    if (put <= 0)
+      break;
+    done += put;
+  }
+  free(chunk);
+  if (done == 0 && wanted)
+    return -1;
+  return done / 4;
+}
+
 void ecall(void) {
 
   if (cpu.registers[17] == 1) {
+    guest_console_flush(); // the guest may be waiting on a prompt
     cpu.registers[10] = getchar();
     return;
   } else if (cpu.registers[17] == 2) { // Set A0 to getchar(c)
-    putchar((char)cpu.registers[10]);
+    char c = cpu.registers[10];
+    guest_console_write(&c, 1);
     return;
   } else if (cpu.registers[17] == 3 || cpu.registers[17] == 93) { // Stop sim
     cpu.cpu_running = 0;
     return;
+  } else if (cpu.registers[17] == 4) { // read_int_buffer(file, buffer, max_size)
+    cpu.registers[10] = guest_read_ints(cpu.registers[10], cpu.registers[11], cpu.registers[12]);
+    return;
+  } else if (cpu.registers[17] == 5) { // write_int_buffer(file, buffer, size)
+    cpu.registers[10] = guest_write_ints(cpu.registers[10], cpu.registers[11], cpu.registers[12]);
+    return;
+  } else if (cpu.registers[17] == 6) { // close_file(file)
+    cpu.registers[10] = guest_close(cpu.registers[10]);
+    return;
+  } else if (cpu.registers[17] == 8) { // open_file(path, flags)
+    cpu.registers[10] = guest_open(cpu.registers[10], cpu.registers[11]);
+    return;
+  } else if (cpu.registers[17] == 7) { // write_string(s)
+    cpu.registers[10] = guest_write_string(cpu.registers[10]);
+    return;
   } else {
     cpu.cpu_running = 0;
+    guest_console_flush();
     char buf[64];
     sprintf(buf, "Value of a7: %d\n", cpu.registers[17]);
     fputs(buf, stdout);
@@ -388,7 +617,7 @@ void execute_r_type(rv_fields_t instruction) {
       return;
     }
     case 0x4: {
-      div(instruction.rd, instruction.rs1, instruction.rs2);
+      divs(instruction.rd, instruction.rs1, instruction.rs2);
       return;
     }
     case 0x5: {
@@ -537,194 +766,748 @@ void execute_u_type(rv_fields_t instruction) {
   }
 }
 
-int get_instruction_type(int inst, struct Stat *stat) {
+// Branch accounting shared by every execution path. pc is the pc after the branch and
+// stat->insns counts the instructions before it, in every engine.
+void record_branch(struct Stat *stat, uint32_t pc, int32_t imm, int actual_taken) {
+  stat->branches++;
+  if (profile) {
+    struct bprofile_entry *e = bprofile_lookup(profile, actual_taken ? pc - imm : pc - 4);
+    e->executions++;
+    e->taken += actual_taken;
+    predictor_set_record_misses(predictors, pc, imm, actual_taken, bprofile_misses(profile, e));
+  } else {
+    predictor_set_record(predictors, pc, imm, actual_taken);
+  }
+  if (sweep)
+    predictor_sweep_record(sweep, pc, actual_taken);
+  if (trace) {
+    uint32_t branch_pc = actual_taken ? pc - imm : pc - 4;
+    btrace_write(trace, branch_pc, branch_pc + imm, actual_taken, stat->insns + 1);
+  }
+  if (outcomes)
+    outcome_write(outcomes, pc, imm, actual_taken);
+}
+
+// Jump accounting shared by every execution path. pc is the address of the jal or jalr, cpu.pc
+// holds its target and rs1 is -1 for jal.
+static void record_jump(struct Stat *stat, uint32_t pc, int rd, int rs1) {
+  stat->jumps++;
+  if (btb == NULL)
+    return;
+  switch (btb_jump(btb, pc, cpu.pc, rd, rs1)) {
+  case BTB_HIT: break;
+  case BTB_WRONG: stat->btb_wrong++; break;
+  case RAS_WRONG: stat->ras_wrong++; /* fall through */
+  case RAS_HIT: stat->returns++; break;
+  }
+}
+
+// Handlers for decoded instructions. Each one executes the instruction, advances the pc and
+// returns the log flag (2 for jumps, 0 otherwise).
+
+static int handle_r_type(const rv_fields_t *f, struct Stat *stat) {
+  (void)stat;
+  execute_r_type(*f);
+  cpu.pc += 4;
+  return 0;
+}
+
+static int handle_i_type(const rv_fields_t *f, struct Stat *stat) {
+  (void)stat;
+  execute_i_type(*f);
+  cpu.pc += 4;
+  return 0;
+}
+
+static int handle_s_type(const rv_fields_t *f, struct Stat *stat) {
+  (void)stat;
+  execute_s_type(*f);
+  cpu.pc += 4;
+  return 0;
+}
+
+static int handle_b_type(const rv_fields_t *f, struct Stat *stat) {
+  // Predictors are indexed by the pc after the branch has been resolved
+  int actual_taken = execute_b_type(*f);
+  record_branch(stat, cpu.pc, f->imm, actual_taken);
+  return 0;
+}
+
+static int handle_u_type(const rv_fields_t *f, struct Stat *stat) {
+  (void)stat;
+  execute_u_type(*f);
+  cpu.pc += 4;
+  return 0;
+}
+
+static void check_jump_target(void) {
+  if (cpu.pc % 4 != 0) {
+    guest_console_flush();
+    printf("Pc was : %d that is not a valid address \n", cpu.pc);
+    fflush(stdout);
+  }
+}
+
+static int handle_jal(const rv_fields_t *f, struct Stat *stat) {
+  uint32_t pc = cpu.pc;
+  execute_j_type(*f);
+  check_jump_target();
+  record_jump(stat, pc, f->rd, -1);
+  return 2;
+}
+
+static int handle_jalr(const rv_fields_t *f, struct Stat *stat) {
+  uint32_t pc = cpu.pc;
+  execute_i_type(*f);
+  check_jump_target();
+  record_jump(stat, pc, f->rd, f->rs1);
+  return 2;
+}
+
+static int handle_unknown(const rv_fields_t *f, struct Stat *stat) {
+  (void)f;
+  (void)stat;
+  cpu.pc += 4;
+  return 0;
+}
+
+// Map decoded fields to a flat operation number, following the execute_*_type dispatch.
+static enum rv_op classify_instruction(const rv_fields_t *f) {
+  static const enum rv_op r_base[8] = {OP_ADD, OP_SLL, OP_SLT, OP_SLTU,
+                                       OP_XOR, OP_SRL, OP_OR,  OP_AND};
+  static const enum rv_op r_mul[8] = {OP_MUL, OP_MULH, OP_MULSU, OP_MULU,
+                                      OP_DIV, OP_DIVU, OP_REM,   OP_REMU};
+  static const enum rv_op i_alu[8] = {OP_ADDI, OP_SLLI, OP_SLTI, OP_SLTIU,
+                                      OP_XORI, OP_SRLI, OP_ORI,  OP_ANDI};
+  static const enum rv_op loads[8] = {OP_LB, OP_LH, OP_LW, OP_NOP, OP_LBU, OP_LHU, OP_NOP, OP_NOP};
+  static const enum rv_op stores[8] = {OP_SB, OP_SH, OP_SW, OP_NOP, OP_NOP, OP_NOP, OP_NOP, OP_NOP};
+  static const enum rv_op branches[8] = {OP_BEQ, OP_BNE, OP_GENERIC, OP_GENERIC,
+                                         OP_BLT, OP_BGE, OP_BLTU,    OP_BGEU};
+  switch (f->opcode) {
+  case 0x33:
+    if (f->funct7 == 0x00)
+      return r_base[f->funct3];
+    if (f->funct7 == 0x01)
+      return r_mul[f->funct3];
+    if (f->funct7 == 0x20)
+      return f->funct3 == 0x0 ? OP_SUB : f->funct3 == 0x5 ? OP_SRA : OP_NOP;
+    return OP_NOP;
+  case 0x13: return i_alu[f->funct3];
+  case 0x03: return loads[f->funct3];
+  case 0x23: return stores[f->funct3];
+  case 0x63: return branches[f->funct3];
+  case 0x37: return OP_LUI;
+  case 0x17: return OP_AUIPC;
+  case 0x6F: return OP_JAL;
+  case 0x67: return f->funct3 == 0x0 ? OP_JALR : OP_GENERIC;
+  case 0x73: return f->funct3 == 0x0 ? OP_ECALL : OP_NOP;
+  default: return OP_NOP;
+  }
+}
+
+// Decode a raw instruction word once into its fields and the handler that executes it.
+void decode_instruction(uint32_t inst, struct decoded_insn *d) {
   rv_fields_t instruction_fields = {0};
   instruction_fields.opcode = inst & 0x7F;
-  int flag = 0;
+  d->raw = inst;
   switch (instruction_fields.opcode) {
-  case 0x33: { // R-type ALU
+  case 0x33: // R-type ALU
     decode_r(inst, &instruction_fields);
-    execute_r_type(instruction_fields);
-    cpu.pc += 4;
-  } break;
-  case 0x13: { // I-type ALU
-    decode_i(inst, &instruction_fields);
-    execute_i_type(instruction_fields);
-    cpu.pc += 4;
+    d->handler = handle_r_type;
     break;
-  }
-  case 0x03: { // loads
+  case 0x13: // I-type ALU
+  case 0x03: // loads
+  case 0x73: // ecall
     decode_i(inst, &instruction_fields);
-    execute_i_type(instruction_fields);
-    cpu.pc += 4;
-  } break;
-
-  case 0x23: { // Stores-type
+    d->handler = handle_i_type;
+    break;
+  case 0x23: // Stores-type
     decode_s(inst, &instruction_fields);
-    execute_s_type(instruction_fields);
-    cpu.pc += 4;
+    d->handler = handle_s_type;
     break;
-  }
-  case 0x63: { // branches ALU
-    stat->branches++;
+  case 0x63: // branches
     decode_b(inst, &instruction_fields);
-    int flag = execute_b_type(instruction_fields);
-    int actual_taken = flag;
+    d->handler = handle_b_type;
+    break;
+  case 0x37: // lui
+  case 0x17: // auipc
+    decode_u(inst, &instruction_fields);
+    d->handler = handle_u_type;
+    break;
+  case 0x6F: // jal
+    decode_j(inst, &instruction_fields);
+    d->handler = handle_jal;
+    break;
+  case 0x67: // jalr
+    decode_i(inst, &instruction_fields);
+    d->handler = handle_jalr;
+    break;
+  default: d->handler = handle_unknown; break;
+  }
+  d->fields = instruction_fields;
+  d->op = classify_instruction(&instruction_fields);
+}
 
-    if (actual_taken != 0) //(NT)
-      stat->wrong_nt++;
+int get_instruction_type(int inst, struct Stat *stat) {
+  struct decoded_insn d;
+  decode_instruction(inst, &d);
+  return d.handler(&d.fields, stat);
+}
 
-    int predicted_btfnt = (instruction_fields.imm < 0); //(BTFNT)
-    if (predicted_btfnt != actual_taken)
-      stat->wrong_btfnt++;
+// Pre-decoded instruction cache covering the text segment, one entry per word. Entries are
+// filled lazily on first execution; a NULL handler marks an entry not yet decoded.
+static struct decoded_insn *icache = NULL;
+static uint32_t icache_start = 0;
+static uint32_t icache_size = 0; // in entries
+static struct decoded_insn icache_scratch;
+
+static void icache_create(uint32_t text_start, uint32_t text_end) {
+  icache_start = text_start & ~3u;
+  icache_size = text_end > icache_start ? (text_end - icache_start + 3) >> 2 : 0;
+  icache = calloc(icache_size ? icache_size : 1, sizeof(struct decoded_insn));
+}
+
+static void icache_delete(void) {
+  free(icache);
+  icache = NULL;
+  icache_size = 0;
+}
 
-    //BIMODAL
-    int index = (cpu.pc >> 2) & (1024 - 1);
+// Look up the decoded instruction at pc. Code outside the text segment is decoded every time.
+struct decoded_insn *fetch_decoded(uint32_t pc) {
+  uint32_t index = (pc - icache_start) >> 2;
+  if (index < icache_size && (pc & 3) == 0) {
+    struct decoded_insn *d = &icache[index];
+    if (d->handler == NULL)
+      decode_instruction(memory_rd_w(cpu.mem, pc), d);
+    return d;
+  }
+  decode_instruction(memory_rd_w(cpu.mem, pc), &icache_scratch);
+  return &icache_scratch;
+}
 
-    // prediction from range 0–5
-    int predicted_taken_bimodal = (bimodal[index] >= 3);
+// Direct-threaded engine. Each text word gets a label address plus its operands, and every
+// operation jumps straight to the label of the next one (computed goto, GNU C). Straight-line
+// code walks the array; jumps and branches re-index it from the pc. Entries start out pointing
+// at a translate stub, so code is converted on first execution.
+struct threaded_insn {
+  const void *label;
+  uint8_t rd, rs1, rs2;
+  int32_t imm;
+};
+
+// Labels as values are a GNU extension; the Makefile builds with -pedantic
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+static void run_threaded(struct Stat *stats) {
+  static const void *op_labels[NUM_OPS] = {
+      [OP_GENERIC] = &&op_generic, [OP_NOP] = &&op_nop,     [OP_ADD] = &&op_add,
+      [OP_SUB] = &&op_sub,         [OP_XOR] = &&op_xor,     [OP_OR] = &&op_or,
+      [OP_AND] = &&op_and,         [OP_SLL] = &&op_sll,     [OP_SRL] = &&op_srl,
+      [OP_SRA] = &&op_sra,         [OP_SLT] = &&op_slt,     [OP_SLTU] = &&op_sltu,
+      [OP_MUL] = &&op_mul,         [OP_MULH] = &&op_mulh,   [OP_MULSU] = &&op_mulsu,
+      [OP_MULU] = &&op_mulu,       [OP_DIV] = &&op_div,     [OP_DIVU] = &&op_divu,
+      [OP_REM] = &&op_rem,         [OP_REMU] = &&op_remu,   [OP_ADDI] = &&op_addi,
+      [OP_XORI] = &&op_xori,       [OP_ORI] = &&op_ori,     [OP_ANDI] = &&op_andi,
+      [OP_SLLI] = &&op_slli,       [OP_SRLI] = &&op_srli,   [OP_SLTI] = &&op_slti,
+      [OP_SLTIU] = &&op_sltiu,     [OP_LB] = &&op_lb,       [OP_LH] = &&op_lh,
+      [OP_LW] = &&op_lw,           [OP_LBU] = &&op_lbu,     [OP_LHU] = &&op_lhu,
+      [OP_SB] = &&op_sb,           [OP_SH] = &&op_sh,       [OP_SW] = &&op_sw,
+      [OP_LUI] = &&op_lui,         [OP_AUIPC] = &&op_auipc, [OP_BEQ] = &&op_beq,
+      [OP_BNE] = &&op_bne,         [OP_BLT] = &&op_blt,     [OP_BGE] = &&op_bge,
+      [OP_BLTU] = &&op_bltu,       [OP_BGEU] = &&op_bgeu,   [OP_JAL] = &&op_jal,
+      [OP_JALR] = &&op_jalr,       [OP_ECALL] = &&op_ecall,
+  };
+
+  // One extra entry past the end catches straight-line execution leaving the text segment
+  struct threaded_insn *code = malloc((icache_size + 1) * sizeof(struct threaded_insn));
+  for (uint32_t i = 0; i < icache_size; i++)
+    code[i].label = &&translate;
+  code[icache_size].label = &&outside;
+  long int insns = stats->insns;
+  struct threaded_insn *t;
+  int taken;
+
+#define DISPATCH() goto *t->label
+#define NEXT()                                                                                     \
+  do {                                                                                             \
+    cpu.pc += 4;                                                                                   \
+    insns++;                                                                                       \
+    t++;                                                                                           \
+    DISPATCH();                                                                                    \
+  } while (0)
+#define JUMP()                                                                                     \
+  do {                                                                                             \
+    insns++;                                                                                       \
+    goto resolve;                                                                                  \
+  } while (0)
+#define BRANCH(op)                                                                                 \
+  do {                                                                                             \
+    taken = op(t->rs1, t->rs2, t->imm);                                                            \
+    stats->insns = insns;                                                                          \
+    record_branch(stats, cpu.pc, t->imm, taken);                                                   \
+    JUMP();                                                                                        \
+  } while (0)
+
+resolve: {
+  uint32_t index = (cpu.pc - icache_start) >> 2;
+  if (index < icache_size && (cpu.pc & 3) == 0) {
+    t = &code[index];
+    DISPATCH();
+  }
+}
+outside:
+  // Code outside the text segment is executed one instruction at a time through the handlers
+  while (cpu.cpu_running) {
+    uint32_t index = (cpu.pc - icache_start) >> 2;
+    if (index < icache_size && (cpu.pc & 3) == 0)
+      goto resolve;
+    struct decoded_insn *d = fetch_decoded(cpu.pc);
+    stats->insns = insns;
+    d->handler(&d->fields, stats);
+    insns++;
+  }
+  goto done;
+
+translate: {
+  struct decoded_insn *d = fetch_decoded(cpu.pc);
+  t->label = op_labels[d->op];
+  t->rd = d->fields.rd;
+  t->rs1 = d->fields.rs1;
+  t->rs2 = d->fields.rs2;
+  t->imm = d->fields.imm;
+  DISPATCH();
+}
 
+op_generic: {
+  struct decoded_insn *d = &icache[t - code];
+  stats->insns = insns;
+  d->handler(&d->fields, stats);
+  JUMP();
+}
+op_nop: NEXT();
+op_add: add(t->rd, t->rs1, t->rs2); NEXT();
+op_sub: sub(t->rd, t->rs1, t->rs2); NEXT();
+op_xor: xor(t->rd, t->rs1, t->rs2); NEXT();
+op_or: or(t->rd, t->rs1, t->rs2); NEXT();
+op_and: and(t->rd, t->rs1, t->rs2); NEXT();
+op_sll: sll(t->rd, t->rs1, t->rs2); NEXT();
+op_srl: srl(t->rd, t->rs1, t->rs2); NEXT();
+op_sra: sra(t->rd, t->rs1, t->rs2); NEXT();
+op_slt: slt(t->rd, t->rs1, t->rs2); NEXT();
+op_sltu: sltu(t->rd, t->rs1, t->rs2); NEXT();
+op_mul: mul(t->rd, t->rs1, t->rs2); NEXT();
+op_mulh: mulh(t->rd, t->rs1, t->rs2); NEXT();
+op_mulsu: mulsu(t->rd, t->rs1, t->rs2); NEXT();
+op_mulu: mulu(t->rd, t->rs1, t->rs2); NEXT();
+op_div: divs(t->rd, t->rs1, t->rs2); NEXT();
+op_divu: divu(t->rd, t->rs1, t->rs2); NEXT();
+op_rem: rem(t->rd, t->rs1, t->rs2); NEXT();
+op_remu: remu(t->rd, t->rs1, t->rs2); NEXT();
+op_addi: addi(t->rd, t->rs1, t->imm); NEXT();
+op_xori: xori(t->rd, t->rs1, t->imm); NEXT();
+op_ori: ori(t->rd, t->rs1, t->imm); NEXT();
+op_andi: andi(t->rd, t->rs1, t->imm); NEXT();
+op_slli: slli(t->rd, t->rs1, t->imm); NEXT();
+op_srli: srli(t->rd, t->rs1, t->imm); NEXT();
+op_slti: slti(t->rd, t->rs1, t->imm); NEXT();
+op_sltiu: sltiu(t->rd, t->rs1, t->imm); NEXT();
+op_lb: lb(t->rd, t->imm, t->rs1); NEXT();
+op_lh: lh(t->rd, t->imm, t->rs1); NEXT();
+op_lw: lw(t->rd, t->imm, t->rs1); NEXT();
+op_lbu: lbu(t->rd, t->imm, t->rs1); NEXT();
+op_lhu: lhu(t->rd, t->imm, t->rs1); NEXT();
+op_sb: sb(t->rs1, t->rs2, t->imm); NEXT();
+op_sh: sh(t->rs1, t->rs2, t->imm); NEXT();
+op_sw: sw(t->rs1, t->rs2, t->imm); NEXT();
+op_lui: lui(t->rd, t->imm); NEXT();
+op_auipc: auipc(t->rd, t->imm); NEXT();
+op_beq: BRANCH(beq);
+op_bne: BRANCH(bne);
+op_blt: BRANCH(blt);
+op_bge: BRANCH(bge);
+op_bltu: BRANCH(bltu);
+op_bgeu: BRANCH(bgeu);
+op_jal: {
+  uint32_t pc = cpu.pc;
+  jal(t->rd, t->imm);
+  check_jump_target();
+  record_jump(stats, pc, t->rd, -1);
+  JUMP();
+}
+op_jalr: {
+  uint32_t pc = cpu.pc;
+  jalr(t->rd, t->rs1, t->imm);
+  check_jump_target();
+  record_jump(stats, pc, t->rd, t->rs1);
+  JUMP();
+}
+op_ecall:
+  ecall();
+  if (!cpu.cpu_running) {
+    cpu.pc += 4;
+    insns++;
+    goto done;
+  }
+  NEXT();
 
-    if (predicted_taken_bimodal != actual_taken)
-        stat->wrong_bimodal++;
+#undef BRANCH
+#undef JUMP
+#undef NEXT
+#undef DISPATCH
 
-    if (actual_taken == 1) {
-        if (bimodal[index] < 5)
-            bimodal[index]++;
-    } else {
-        if (bimodal[index] > 0)
-            bimodal[index]--;
-    }
-    
-    //GSHARE
-    int index2 = ((cpu.pc >> 2) ^ ghr) & (1024 - 1);
-    int predicted_taken_gshare = (gshare_table[index2] >= 3);
+done:
+  stats->insns = insns;
+  free(code);
+}
+#pragma GCC diagnostic pop
+
+// Basic-block engine. Code is split into blocks ending at a branch, jal, jalr or ecall and
+// each block is translated once into an array of micro-ops. Blocks keep pointers to their
+// successors, so after the first pass the dispatcher follows the chain without looking the
+// next pc up again. Instruction counts are added per block; a block always runs to its end
+// because only its terminator can stop the machine.
+#define MAX_BLOCK_LEN 64
+
+struct block {
+  uint32_t start_pc;
+  uint32_t term_pc;        // pc of the terminator, or of the next block if there is none
+  uint32_t len;            // instructions in the block, terminator included
+  uint32_t num_body;       // micro-ops before the terminator
+  struct micro_op term;    // OP_NOP when the block was cut without a control transfer
+  struct block *taken;     // successor when the terminator transfers control (last target for jalr)
+  struct block *fallthrough;
+  long int executions;     // for the JIT threshold and the execution profile
+  jit_block_fn jit;        // native code for the block, NULL while interpreted
+  int jit_term;            // the native code also runs the terminator
+  struct micro_op body[];
+};
+
+static struct block **block_map = NULL;
+
+static int is_block_terminator(enum rv_op op) {
+  return (op >= OP_BEQ && op <= OP_ECALL) || op == OP_GENERIC;
+}
 
-    // count wrong predictions
-    if (predicted_taken_gshare != actual_taken)
-        stat->wrong_gshare++;
+static struct micro_op make_micro_op(const struct decoded_insn *d, uint32_t pc) {
+  struct micro_op u = {.op = d->op,
+                       .rd = d->fields.rd,
+                       .rs1 = d->fields.rs1,
+                       .rs2 = d->fields.rs2,
+                       .imm = d->fields.imm};
+  // auipc only depends on its own pc, which is known at translation time
+  if (d->op == OP_AUIPC)
+    u.imm = pc + (d->fields.imm << 12);
+  return u;
+}
 
-    // update predictor
-    if (actual_taken == 1) {
-        if (gshare_table[index2] < 5)
-            gshare_table[index2]++;
-    } else {
-        if (gshare_table[index2] > 0)
-            gshare_table[index2]--;
+static struct block *block_translate(uint32_t pc) {
+  struct micro_op ops[MAX_BLOCK_LEN];
+  uint32_t num_body = 0;
+  uint32_t end_pc = pc;
+  struct micro_op term = {.op = OP_NOP};
+  uint32_t len = 0;
+  while (len < MAX_BLOCK_LEN && ((end_pc - icache_start) >> 2) < icache_size) {
+    struct decoded_insn *d = fetch_decoded(end_pc);
+    len++;
+    if (is_block_terminator(d->op)) {
+      term = make_micro_op(d, end_pc);
+      break;
     }
+    ops[num_body++] = make_micro_op(d, end_pc);
+    end_pc += 4;
+  }
+  struct block *b = malloc(sizeof(struct block) + num_body * sizeof(struct micro_op));
+  b->start_pc = pc;
+  b->term_pc = end_pc;
+  b->len = len;
+  b->num_body = num_body;
+  b->term = term;
+  b->taken = NULL;
+  b->fallthrough = NULL;
+  b->executions = 0;
+  b->jit = NULL;
+  b->jit_term = 0;
+  memcpy(b->body, ops, num_body * sizeof(struct micro_op));
+  return b;
+}
 
-    ghr = ((ghr << 1) | actual_taken) & 1023;
+// Find or translate the block starting at pc. Returns NULL outside the text segment.
+static struct block *block_lookup(uint32_t pc) {
+  uint32_t index = (pc - icache_start) >> 2;
+  if (index >= icache_size || (pc & 3))
+    return NULL;
+  if (block_map[index] == NULL)
+    block_map[index] = block_translate(pc);
+  return block_map[index];
+}
 
-    break;
+// Follow a chain slot for a successor with a fixed start pc, filling it on first use
+static struct block *block_chain(struct block **slot, uint32_t pc) {
+  if (*slot == NULL)
+    *slot = block_lookup(pc);
+  return *slot;
+}
+
+// Successor after a jalr: the last target is kept in the taken slot and checked against the pc
+static struct block *block_chain_indirect(struct block *b) {
+  if (b->taken == NULL || b->taken->start_pc != cpu.pc)
+    b->taken = block_lookup(cpu.pc);
+  return b->taken;
+}
+
+static inline void execute_micro_op(const struct micro_op *u) {
+  switch (u->op) {
+  case OP_ADD: add(u->rd, u->rs1, u->rs2); break;
+  case OP_SUB: sub(u->rd, u->rs1, u->rs2); break;
+  case OP_XOR: xor(u->rd, u->rs1, u->rs2); break;
+  case OP_OR: or(u->rd, u->rs1, u->rs2); break;
+  case OP_AND: and(u->rd, u->rs1, u->rs2); break;
+  case OP_SLL: sll(u->rd, u->rs1, u->rs2); break;
+  case OP_SRL: srl(u->rd, u->rs1, u->rs2); break;
+  case OP_SRA: sra(u->rd, u->rs1, u->rs2); break;
+  case OP_SLT: slt(u->rd, u->rs1, u->rs2); break;
+  case OP_SLTU: sltu(u->rd, u->rs1, u->rs2); break;
+  case OP_MUL: mul(u->rd, u->rs1, u->rs2); break;
+  case OP_MULH: mulh(u->rd, u->rs1, u->rs2); break;
+  case OP_MULSU: mulsu(u->rd, u->rs1, u->rs2); break;
+  case OP_MULU: mulu(u->rd, u->rs1, u->rs2); break;
+  case OP_DIV: divs(u->rd, u->rs1, u->rs2); break;
+  case OP_DIVU: divu(u->rd, u->rs1, u->rs2); break;
+  case OP_REM: rem(u->rd, u->rs1, u->rs2); break;
+  case OP_REMU: remu(u->rd, u->rs1, u->rs2); break;
+  case OP_ADDI: addi(u->rd, u->rs1, u->imm); break;
+  case OP_XORI: xori(u->rd, u->rs1, u->imm); break;
+  case OP_ORI: ori(u->rd, u->rs1, u->imm); break;
+  case OP_ANDI: andi(u->rd, u->rs1, u->imm); break;
+  case OP_SLLI: slli(u->rd, u->rs1, u->imm); break;
+  case OP_SRLI: srli(u->rd, u->rs1, u->imm); break;
+  case OP_SLTI: slti(u->rd, u->rs1, u->imm); break;
+  case OP_SLTIU: sltiu(u->rd, u->rs1, u->imm); break;
+  case OP_LB: lb(u->rd, u->imm, u->rs1); break;
+  case OP_LH: lh(u->rd, u->imm, u->rs1); break;
+  case OP_LW: lw(u->rd, u->imm, u->rs1); break;
+  case OP_LBU: lbu(u->rd, u->imm, u->rs1); break;
+  case OP_LHU: lhu(u->rd, u->imm, u->rs1); break;
+  case OP_SB: sb(u->rs1, u->rs2, u->imm); break;
+  case OP_SH: sh(u->rs1, u->rs2, u->imm); break;
+  case OP_SW: sw(u->rs1, u->rs2, u->imm); break;
+  case OP_LUI: lui(u->rd, u->imm); break;
+  case OP_AUIPC: cpu.registers[u->rd] = u->imm; break;
+  default: break;
   }
-  case 0x37: { // lui ALU
-    decode_u(inst, &instruction_fields);
-    execute_u_type(instruction_fields);
+}
+
+// Run the terminator of b with cpu.pc at its address and return the next block (or NULL)
+static struct block *execute_terminator(struct block *b, struct Stat *stats) {
+  const struct micro_op *u = &b->term;
+  int taken;
+  switch (u->op) {
+  case OP_BEQ: taken = beq(u->rs1, u->rs2, u->imm); break;
+  case OP_BNE: taken = bne(u->rs1, u->rs2, u->imm); break;
+  case OP_BLT: taken = blt(u->rs1, u->rs2, u->imm); break;
+  case OP_BGE: taken = bge(u->rs1, u->rs2, u->imm); break;
+  case OP_BLTU: taken = bltu(u->rs1, u->rs2, u->imm); break;
+  case OP_BGEU: taken = bgeu(u->rs1, u->rs2, u->imm); break;
+  case OP_JAL:
+    jal(u->rd, u->imm);
+    check_jump_target();
+    record_jump(stats, b->term_pc, u->rd, -1);
+    return block_chain(&b->taken, cpu.pc);
+  case OP_JALR:
+    jalr(u->rd, u->rs1, u->imm);
+    check_jump_target();
+    record_jump(stats, b->term_pc, u->rd, u->rs1);
+    return block_chain_indirect(b);
+  case OP_ECALL:
+    ecall();
     cpu.pc += 4;
-    break;
+    return block_chain(&b->fallthrough, cpu.pc);
+  case OP_GENERIC: {
+    struct decoded_insn *d = fetch_decoded(cpu.pc);
+    d->handler(&d->fields, stats);
+    return block_lookup(cpu.pc);
   }
-  case 0x17: { // auipc ALU
-    decode_u(inst, &instruction_fields);
-    execute_u_type(instruction_fields);
-    cpu.pc += 4;
-    break;
+  default: return block_chain(&b->fallthrough, cpu.pc);
   }
+  record_branch(stats, cpu.pc, u->imm, taken);
+  if (taken)
+    return block_chain(&b->taken, cpu.pc);
+  return block_chain(&b->fallthrough, cpu.pc);
+}
 
-  case 0x6F: { // jal ALU
-    decode_j(inst, &instruction_fields);
-    execute_j_type(instruction_fields);
-    flag = 2;
-    if (cpu.pc % 4 != 0) {
-      printf("Pc was : %d that is not a valid address \n", cpu.pc);
-      fflush(stdout);
+// JIT tier on top of the block engine. Blocks executed JIT_THRESHOLD times are compiled to
+// native code. Terminators other than ecall and the odd encodings run in the native code; those
+// two are left to execute_terminator() after the compiled body.
+#define JIT_THRESHOLD 16
+
+static uint32_t jit_branch(struct Stat *stat, uint32_t pc, int32_t imm, int taken) {
+  uint32_t next = taken ? pc + imm : pc + 4;
+  record_branch(stat, next, imm, taken);
+  return next;
+}
+
+static void block_compile(struct block *b) {
+  int native_term = b->term.op == OP_NOP || b->term.op == OP_JAL || b->term.op == OP_JALR ||
+                    (b->term.op >= OP_BEQ && b->term.op <= OP_BGEU);
+  b->jit = jit_compile(b->body, b->num_body, native_term ? &b->term : NULL, b->term_pc);
+  b->jit_term = native_term;
+}
+
+// Pick the successor of a block whose native code has run its terminator; cpu.pc is the target
+static struct block *jit_successor(struct block *b, struct Stat *stats) {
+  switch (b->term.op) {
+  case OP_JAL:
+    check_jump_target();
+    record_jump(stats, b->term_pc, b->term.rd, -1);
+    return block_chain(&b->taken, cpu.pc);
+  case OP_JALR:
+    check_jump_target();
+    record_jump(stats, b->term_pc, b->term.rd, b->term.rs1);
+    return block_chain_indirect(b);
+  case OP_NOP: return block_chain(&b->fallthrough, cpu.pc);
+  default:
+    if (cpu.pc == b->term_pc + b->term.imm)
+      return block_chain(&b->taken, cpu.pc);
+    return block_chain(&b->fallthrough, cpu.pc);
+  }
+}
+
+static void run_blocks(struct Stat *stats, int use_jit) {
+  block_map = calloc(icache_size ? icache_size : 1, sizeof(struct block *));
+  if (use_jit)
+    use_jit = jit_init(jit_branch);
+  struct block *b = block_lookup(cpu.pc);
+  while (cpu.cpu_running) {
+    if (b == NULL) {
+      // Outside the text segment: one instruction at a time through the handlers
+      struct decoded_insn *d = fetch_decoded(cpu.pc);
+      if (exec_profile)
+        eprofile_count(exec_profile, cpu.pc);
+      d->handler(&d->fields, stats);
+      stats->insns++;
+      b = block_lookup(cpu.pc);
+      continue;
     }
-    break;
+    // The terminator is counted after it has run, so branches see the count before them
+    stats->insns += b->num_body;
+    b->executions++;
+    uint32_t term_len = b->len - b->num_body;
+    if (b->jit) {
+      cpu.pc = b->jit(cpu.registers, cpu.mem, stats);
+      b = b->jit_term ? jit_successor(b, stats) : execute_terminator(b, stats);
+      stats->insns += term_len;
+      continue;
+    }
+    if (use_jit && b->executions == JIT_THRESHOLD)
+      block_compile(b);
+    for (uint32_t i = 0; i < b->num_body; i++)
+      execute_micro_op(&b->body[i]);
+    cpu.pc = b->term_pc;
+    b = execute_terminator(b, stats);
+    stats->insns += term_len;
   }
-  case 0x67: { // jalr ALU
-    decode_i(inst, &instruction_fields);
-    execute_i_type(instruction_fields);
-    flag = 2;
-    if (cpu.pc % 4 != 0) {
-      printf("Pc was : %d that is not a valid address \n", cpu.pc);
-      fflush(stdout);
+  for (uint32_t i = 0; i < icache_size; i++) {
+    // Blocks run to their end, so every instruction of a block ran as often as the block
+    if (exec_profile && block_map[i])
+      eprofile_add_range(exec_profile, block_map[i]->start_pc, block_map[i]->len,
+                         block_map[i]->executions);
+    free(block_map[i]);
+  }
+  free(block_map);
+  block_map = NULL;
+  if (use_jit)
+    jit_shutdown();
+}
+
+// The original engine: fetch the decoded instruction for the pc and call its handler.
+// The only engine that supports the -l and -L instruction logs. The -l text is formatted by a
+// writer thread, or right here if the thread cannot be started.
+static void run_switch(struct Stat *stats, FILE *log_file) {
+  text_log = log_file ? log_writer_start(log_file) : NULL;
+  struct disasm_cache *cache = log_file && !text_log ? disasm_cache_create() : NULL;
+  int previous_flag = 0;
+  while (cpu.cpu_running) {
+    struct decoded_insn *d = fetch_decoded(cpu.pc);
+    if (exec_profile)
+      eprofile_count(exec_profile, cpu.pc);
+    int flag = d->handler(&d->fields, stats);
+    uint32_t rd_value = cpu.registers[d->fields.rd];
+    if (text_log) {
+      log_writer_push(text_log, stats->insns, cpu.pc, d->raw, rd_value, flag);
+    } else if (log_file) {
+      struct binlog_record r = {.insns = stats->insns, .pc = cpu.pc, .raw = d->raw,
+                                .rd_value = rd_value, .flag = flag};
+      binlog_render(cache, &r, previous_flag, log_file);
+      previous_flag = flag;
     }
-    break;
-  } break;
-  case 0x73: { // ecall ALU
-    decode_i(inst, &instruction_fields);
-    execute_i_type(instruction_fields);
-    cpu.pc += 4;
-    break;
+    if (binlog)
+      binlog_write(binlog, stats->insns, cpu.pc, d->raw, rd_value, flag);
+    stats->insns += 1;
   }
-  default: {cpu.pc += 4; break;}
+  if (text_log) {
+    log_writer_finish(text_log);
+    text_log = NULL;
   }
-  return flag;
+  if (cache)
+    disasm_cache_delete(cache);
 }
 
-struct Stat simulate(struct memory *mem, int start_addr, FILE *log_file, struct symbols* symbols) {
+struct Stat simulate(struct memory *mem, struct program_info *prog_info, FILE *log_file,
+                     struct symbols *symbols, const struct sim_options *options) {
   (void)symbols; //Avoid warning
   cpu.registers[0] = 0;
   cpu.mem = mem;
   cpu.cpu_running = 1;
-  cpu.pc = start_addr;
+  cpu.pc = prog_info->start;
   struct Stat stats;
   stats.insns = 0;
-  stats.wrong_nt = 0;
-  stats.wrong_bimodal = 0;
-  stats.wrong_gshare = 0;
-  stats.wrong_btfnt = 0;
   stats.branches = 0;
-  int instruction;
-  int flag1 = 0;
-
-  //Let the prediction scale be range 0-5. Inizialising them starting in the middle
-  for (int i = 0; i < 1024; i++) {
-      bimodal[i] = 2;
-      gshare_table[i] = 2;
-  }
-  ghr = 0;
-
-  while (cpu.cpu_running) {
-    if (log_file){
-        fprintf(log_file, "%ld", stats.insns);
-        if (flag1 == 1){
-            fwrite((" => "), 1, 4, log_file);
-        } else {
-            fwrite(("    "), 1, 4, log_file);
-        }
-    }
-
-    flag1 = 0;
-    instruction = load_word_from_memory();
-    flag1 = get_instruction_type(instruction, &stats);
-    // Write address first for debug purposes
-    char address[9];
-    snprintf(address, sizeof(address), "%08x", cpu.pc);
-    char result[BUFFSIZE];
-
-    if (log_file){
-    fwrite(address, 1, strlen(address), log_file);
-    fwrite("  :  ", 1, 5, log_file); // space separator
-    uint32_t u = (uint32_t)instruction;
-    fprintf(log_file, "0x%08X", u);
-   
-    fwrite("     ", 1, 5, log_file);
-    disassemble(cpu.pc, instruction, result, BUFFSIZE);
-    
-    if (flag1)
-    if (strlen(result) + 6 < BUFFSIZE) {  // 6 for "   {T}"
-        strcat(result, "   {T}");
-    }
-
-    size_t len1 = strlen(result);
-    if (len1 + 1 < BUFFSIZE) {
-      result[len1] = '\n';
-      result[len1 + 1] = '\0';
-    }
-    fwrite(result, 1, strlen(result), log_file);    
-    
-    }
-    stats.insns += 1;
-  }
+  stats.jumps = 0;
+  stats.returns = 0;
+  stats.btb_wrong = 0;
+  stats.ras_wrong = 0;
+
+  predictors = options->predictors;
+  predictor_set_reset(predictors);
+  sweep = options->sweep;
+  if (sweep)
+    predictor_sweep_reset(sweep);
+  trace = options->trace;
+  outcomes = options->outcomes;
+  btb = options->btb;
+  profile = options->profile;
+  if (profile)
+    bprofile_reset(profile);
+  if (btb)
+    btb_reset(btb);
+  exec_profile = options->exec_profile;
+  if (exec_profile)
+    eprofile_reset(exec_profile);
+  icache_create(prog_info->text_start, prog_info->text_end);
+  guest_files_init();
+  guest_console_tty = isatty(STDOUT_FILENO);
+  memory_set_fault_hook(simulate_fault);
+
+  binlog = options->binlog;
+  int logging = log_file != NULL || binlog != NULL;
+  enum sim_engine engine = options->engine;
+  // The threaded engine has no per-block step to count in, so profiles come from blocks
+  if (exec_profile && engine == ENGINE_THREADED)
+    engine = ENGINE_BLOCK;
+  if (!logging && engine == ENGINE_THREADED)
+    run_threaded(&stats);
+  else if (!logging && engine == ENGINE_BLOCK)
+    run_blocks(&stats, 0);
+  else if (!logging && engine == ENGINE_JIT)
+    run_blocks(&stats, 1);
+  else
+    run_switch(&stats, log_file);
+
+  icache_delete();
+  guest_files_close_all();
+  guest_console_flush();
+  memory_set_fault_hook(NULL);
   return stats;
 }
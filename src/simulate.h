@@ -1,22 +1,47 @@
 #ifndef __SIMULATE_H__
 #define __SIMULATE_H__
 
+#include "bprofile.h"
+#include "binlog.h"
+#include "btb.h"
+#include "btrace.h"
+#include "eprofile.h"
 #include "memory.h"
+#include "outcome.h"
+#include "predictor.h"
 #include "read_elf.h"
+#include "sweep.h"
 #include <stdio.h>
 
 // Simuler RISC-V program i givet lager og fra given start adresse
+// Mispredictions are counted by the predictors in sim_options.predictors
 struct Stat { long int insns; 
-              long int wrong_nt;
-              long int wrong_btfnt;
-              long int wrong_gshare;
-              long int wrong_bimodal;
               long int branches;
+              long int jumps;     // jal and jalr
+              long int returns;   // jumps the return address stack predicted
+              long int btb_wrong; // target mispredictions by the BTB
+              long int ras_wrong; // target mispredictions by the return address stack
               };
 
+// Instruction dispatch engines. All of them produce identical results.
+enum sim_engine { ENGINE_SWITCH, ENGINE_THREADED, ENGINE_BLOCK, ENGINE_JIT };
+
+struct sim_options {
+  enum sim_engine engine;
+  struct predictor_set *predictors; // fed every conditional branch; reset at start
+  struct predictor_sweep *sweep;    // optional, fed like predictors
+  struct btrace_writer *trace;      // optional branch trace output
+  struct outcome_writer *outcomes;  // optional branch outcome dump for predsim
+  struct btb *btb;                  // optional jal/jalr target prediction
+  struct bprofile *profile;         // optional per-branch profile, sized for predictors
+  struct binlog *binlog;            // optional binary instruction log; forces the switch engine
+  struct eprofile *exec_profile;    // optional execution counts; threaded runs as block engine
+};
+
 // NOTE: Use of symbols provide for nicer disassembly, but is not required for A4.
 // Feel free to remove this parameter or pass in a NULL pointer and ignore it.
 
-struct Stat simulate(struct memory *mem, int start_addr, FILE *log_file, struct symbols* symbols);
+struct Stat simulate(struct memory *mem, struct program_info *prog_info, FILE *log_file,
+                     struct symbols *symbols, const struct sim_options *options);
 
 #endif
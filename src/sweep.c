@@ -0,0 +1,220 @@
+#include "sweep.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SWEEP_MIN_ENTRIES 256
+#define SWEEP_MAX_ENTRIES 65536
+#define SWEEP_DEFAULT_MAX 5 // counter maximum without bits=, as for the -b predictors
+
+struct predictor_sweep *predictor_sweep_create(void) {
+  return calloc(1, sizeof(struct predictor_sweep));
+}
+
+void predictor_sweep_delete(struct predictor_sweep *sweep) {
+  free(sweep->offset);
+  free(sweep->index_mask);
+  free(sweep->history_mask);
+  free(sweep->max);
+  free(sweep->misses);
+  free(sweep->entries);
+  free(sweep->history);
+  free(sweep->counter_max);
+  free(sweep->is_gshare);
+  free(sweep->wrong);
+  free(sweep->table);
+  free(sweep);
+}
+
+static unsigned int log2_of(uint32_t n) {
+  unsigned int bits = 0;
+  while ((1u << bits) < n)
+    bits++;
+  return bits;
+}
+
+// Parse "MIN-MAX" or a single number
+static int parse_range(const char *value, size_t len, unsigned long *lo, unsigned long *hi) {
+  char *end;
+  *lo = strtoul(value, &end, 0);
+  if (end == value)
+    return 0;
+  *hi = *lo;
+  if (*end == '-') {
+    const char *second = end + 1;
+    *hi = strtoul(second, &end, 0);
+    if (end == second)
+      return 0;
+  }
+  return end == value + len && *lo <= *hi;
+}
+
+static void sweep_append(struct predictor_sweep *sweep, uint32_t entries, uint32_t history,
+                         int gshare, uint32_t max) {
+  int n = sweep->count++;
+  sweep->entries = realloc(sweep->entries, sweep->count * sizeof(uint32_t));
+  sweep->history = realloc(sweep->history, sweep->count * sizeof(uint32_t));
+  sweep->counter_max = realloc(sweep->counter_max, sweep->count * sizeof(uint32_t));
+  sweep->is_gshare = realloc(sweep->is_gshare, sweep->count);
+  sweep->entries[n] = entries;
+  sweep->history[n] = history;
+  sweep->counter_max[n] = max;
+  sweep->is_gshare[n] = gshare;
+}
+
+// Lay the configurations out as vectors and allocate one table holding all their counters
+static void sweep_layout(struct predictor_sweep *sweep) {
+  sweep->num_vecs = (sweep->count + SWEEP_LANES - 1) / SWEEP_LANES;
+  size_t bytes = sweep->num_vecs * sizeof(sweep_vec);
+  sweep_vec **arrays[] = {&sweep->offset, &sweep->index_mask, &sweep->history_mask,
+                          &sweep->max, &sweep->misses};
+  for (unsigned int a = 0; a < sizeof(arrays) / sizeof(arrays[0]); a++) {
+    free(*arrays[a]);
+    *arrays[a] = aligned_alloc(sizeof(sweep_vec), bytes);
+    memset(*arrays[a], 0, bytes);
+  }
+  uint32_t *offset = (uint32_t *)sweep->offset;
+  uint32_t *index_mask = (uint32_t *)sweep->index_mask;
+  uint32_t *history_mask = (uint32_t *)sweep->history_mask;
+  uint32_t *max = (uint32_t *)sweep->max;
+  uint32_t total = 0;
+  for (int i = 0; i < sweep->count; i++) {
+    offset[i] = total;
+    max[i] = sweep->counter_max[i];
+    index_mask[i] = sweep->entries[i] - 1;
+    history_mask[i] = sweep->is_gshare[i] ? (1u << sweep->history[i]) - 1 : 0;
+    total += sweep->entries[i];
+  }
+  // Padding lanes use a single spare counter at the end of the table
+  for (int i = sweep->count; i < sweep->num_vecs * SWEEP_LANES; i++)
+    offset[i] = total;
+  sweep->table_size = total + 1;
+  free(sweep->table);
+  sweep->table = malloc(sweep->table_size);
+  sweep->wrong = realloc(sweep->wrong, sweep->count * sizeof(long int));
+}
+
+int predictor_sweep_add(struct predictor_sweep *sweep, const char *spec) {
+  size_t type_len = strcspn(spec, ":");
+  int gshare;
+  if (type_len == 7 && !strncmp(spec, "bimodal", 7)) {
+    gshare = 0;
+  } else if (type_len == 6 && !strncmp(spec, "gshare", 6)) {
+    gshare = 1;
+  } else {
+    fprintf(stderr, "Sweeps support bimodal and gshare, not '%.*s'\n", (int)type_len, spec);
+    return 0;
+  }
+  unsigned long entries_lo = SWEEP_MIN_ENTRIES, entries_hi = SWEEP_MAX_ENTRIES;
+  unsigned long history_lo = 0, history_hi = 0;
+  int history_given = 0;
+  uint32_t max = SWEEP_DEFAULT_MAX;
+  const char *arg = spec[type_len] ? spec + type_len + 1 : spec + type_len;
+  while (*arg) {
+    size_t key_len = strcspn(arg, "=,");
+    const char *value = arg + key_len + 1;
+    size_t value_len = strcspn(value, ",");
+    unsigned long lo, hi;
+    if (arg[key_len] != '=' || !parse_range(value, value_len, &lo, &hi)) {
+      fprintf(stderr, "Malformed sweep parameter in '%s'\n", spec);
+      return 0;
+    }
+    if (key_len == 7 && !strncmp(arg, "entries", 7) && lo >= 1 && hi <= (1ul << 24)) {
+      entries_lo = lo;
+      entries_hi = hi;
+    } else if (key_len == 7 && !strncmp(arg, "history", 7) && gshare && hi <= 24) {
+      history_lo = lo;
+      history_hi = hi;
+      history_given = 1;
+    } else if (key_len == 4 && !strncmp(arg, "bits", 4) && lo == hi && lo >= 1 && lo <= 8) {
+      max = (1u << lo) - 1;
+    } else {
+      fprintf(stderr, "Bad sweep parameter '%.*s' in '%s'\n", (int)key_len, arg, spec);
+      return 0;
+    }
+    arg = value + value_len;
+    if (*arg == ',')
+      arg++;
+  }
+  int first = sweep->count;
+  for (uint32_t entries = 1u << log2_of(entries_lo); entries <= entries_hi; entries <<= 1) {
+    unsigned int index_bits = log2_of(entries);
+    if (!gshare) {
+      sweep_append(sweep, entries, 0, 0, max);
+    } else if (!history_given) {
+      sweep_append(sweep, entries, index_bits, 1, max);
+    } else {
+      // Longer histories than index bits are masked away and would repeat the last one
+      for (unsigned long h = history_lo; h <= history_hi && h <= index_bits; h++)
+        sweep_append(sweep, entries, h, 1, max);
+    }
+  }
+  if (sweep->count == first) {
+    fprintf(stderr, "Sweep '%s' has no configurations\n", spec);
+    return 0;
+  }
+  sweep_layout(sweep);
+  return 1;
+}
+
+void predictor_sweep_reset(struct predictor_sweep *sweep) {
+  // Every configuration starts weakly not taken for its own counter width
+  uint32_t *offset = (uint32_t *)sweep->offset;
+  for (int i = 0; i < sweep->count; i++)
+    memset(sweep->table + offset[i], sweep->counter_max[i] / 2, sweep->entries[i]);
+  sweep->table[sweep->table_size - 1] = 0;
+  memset(sweep->misses, 0, sweep->num_vecs * sizeof(sweep_vec));
+  memset(sweep->wrong, 0, sweep->count * sizeof(long int));
+  sweep->ghr = 0;
+  sweep->pending = 0;
+}
+
+// Move the 32-bit vector miss counters into the long totals
+static void sweep_fold(struct predictor_sweep *sweep) {
+  uint32_t *misses = (uint32_t *)sweep->misses;
+  for (int i = 0; i < sweep->count; i++)
+    sweep->wrong[i] += misses[i];
+  memset(sweep->misses, 0, sweep->num_vecs * sizeof(sweep_vec));
+  sweep->pending = 0;
+}
+
+void predictor_sweep_record(struct predictor_sweep *sweep, uint32_t pc, int taken) {
+  const sweep_vec address = (sweep_vec){0} + (pc >> 2);
+  const sweep_vec ghr = (sweep_vec){0} + sweep->ghr;
+  const sweep_vec outcome = (sweep_vec){0} - (uint32_t)(taken != 0); // all ones if taken
+  uint8_t *table = sweep->table;
+  for (int v = 0; v < sweep->num_vecs; v++) {
+    sweep_vec index =
+        sweep->offset[v] + ((address ^ (ghr & sweep->history_mask[v])) & sweep->index_mask[v]);
+    sweep_vec counter;
+    for (int lane = 0; lane < SWEEP_LANES; lane++)
+      counter[lane] = table[index[lane]];
+    const sweep_vec max = sweep->max[v];
+    const sweep_vec threshold = (max + 1) >> 1;
+    // Comparisons yield all ones for true, so subtracting a mask adds one
+    sweep_vec predicted = counter >= threshold;
+    sweep->misses[v] -= predicted ^ outcome;
+    sweep_vec up = counter - (counter < max);
+    sweep_vec down = counter + (counter > 0);
+    counter = (up & outcome) | (down & ~outcome);
+    for (int lane = 0; lane < SWEEP_LANES; lane++)
+      table[index[lane]] = counter[lane];
+  }
+  sweep->ghr = (sweep->ghr << 1) | (taken != 0);
+  if (++sweep->pending == 0x80000000u)
+    sweep_fold(sweep);
+}
+
+void predictor_sweep_print(struct predictor_sweep *sweep, long int branches, FILE *out) {
+  sweep_fold(sweep);
+  fprintf(out,
+          "\nPredictor sweep    entries  history  max   wrong predictions   miss rate\n");
+  for (int i = 0; i < sweep->count; i++) {
+    char history[16] = "-";
+    if (sweep->is_gshare[i])
+      snprintf(history, sizeof(history), "%u", sweep->history[i]);
+    double rate = branches ? 100.0 * sweep->wrong[i] / branches : 0.0;
+    fprintf(out, "%-15s %10u %8s %4u %19ld %10.3f%%\n",
+            sweep->is_gshare[i] ? "GSHARE" : "BIMODAL", sweep->entries[i], history,
+            sweep->counter_max[i], sweep->wrong[i], rate);
+  }
+}
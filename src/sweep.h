@@ -0,0 +1,52 @@
+#ifndef __SWEEP_H__
+#define __SWEEP_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Predictor sweep: many bimodal/gshare configurations evaluated in one simulation. The
+// configurations are kept as a structure of arrays, padded to whole vectors, so the per-branch
+// index computation and counter update run as SIMD operations over all of them at once. Only
+// the table lookups themselves are scalar gathers and scatters.
+
+#define SWEEP_LANES 8
+
+typedef uint32_t sweep_vec __attribute__((vector_size(SWEEP_LANES * sizeof(uint32_t))));
+
+struct predictor_sweep {
+  int count;      // configurations
+  int num_vecs;   // count rounded up to whole vectors
+  uint32_t ghr;   // global history, masked per configuration
+  uint32_t pending; // branches since the 32-bit miss counters were folded into wrong
+  // per-configuration arrays, num_vecs * SWEEP_LANES long
+  sweep_vec *offset;       // start of the configuration's counters in table
+  sweep_vec *index_mask;   // entries - 1
+  sweep_vec *history_mask; // 0 for bimodal
+  sweep_vec *max;          // counter maximum
+  sweep_vec *misses;       // mispredictions since the last fold
+  uint32_t *entries;
+  uint32_t *history;
+  uint32_t *counter_max;
+  char *is_gshare;
+  long int *wrong;
+  uint8_t *table;
+  uint32_t table_size;
+};
+
+struct predictor_sweep *predictor_sweep_create(void);
+void predictor_sweep_delete(struct predictor_sweep *sweep);
+
+// Add configurations from "bimodal[:entries=MIN-MAX,bits=N]" or
+// "gshare[:entries=MIN-MAX,history=MIN-MAX,bits=N]". Every power of two in the entries range
+// is used; gshare gets every history length in range up to log2(entries), defaulting to
+// log2(entries) alone. Reports to stderr and returns 0 on a bad spec, including one whose
+// ranges hold no configuration.
+int predictor_sweep_add(struct predictor_sweep *sweep, const char *spec);
+
+void predictor_sweep_reset(struct predictor_sweep *sweep);
+void predictor_sweep_record(struct predictor_sweep *sweep, uint32_t pc, int taken);
+
+// Table of mispredictions per configuration
+void predictor_sweep_print(struct predictor_sweep *sweep, long int branches, FILE *out);
+
+#endif
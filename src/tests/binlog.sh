@@ -0,0 +1,26 @@
+# simlog must render a -L binary log as exactly the text -l writes, one line per instruction.
+. tests/common.sh
+
+./sim $BENCH/fib.elf -l "$WORK/fib.log" -L "$WORK/fib.bin" -s "$WORK/fib.sum" -- 15 > /dev/null
+./simlog "$WORK/fib.bin" "$WORK/fib.txt" || fail "simlog exited with $?"
+cmp -s "$WORK/fib.log" "$WORK/fib.txt" || fail "fib: simlog text differs from the -l log"
+expect "fib log lines" "$(summary_value "$WORK/fib.sum" "Total executed instructions")" \
+  "$(wc -l < "$WORK/fib.txt")"
+
+# -L alone gives the same log, and -e is overridden with a warning
+./sim $BENCH/fib.elf -e jit -L "$WORK/jit.bin" -- 15 > /dev/null 2> "$WORK/warning"
+expect "-L with -e jit" "Warning: -L runs the switch engine, not jit" "$(cat "$WORK/warning")"
+cmp -s "$WORK/fib.log" <(./simlog "$WORK/jit.bin") || fail "fib: -L alone logs differently"
+
+# The -l writer thread's ring holds 65536 records; a run several times longer must still log
+# every instruction in order
+./sim $BENCH/fib.elf -l "$WORK/long.log" -L "$WORK/long.bin" -s "$WORK/long.sum" -- 20 > /dev/null
+cmp -s "$WORK/long.log" <(./simlog "$WORK/long.bin") || fail "fib 20: -l log differs from -L"
+expect "fib 20 log lines" "$(summary_value "$WORK/long.sum" "Total executed instructions")" \
+  "$(wc -l < "$WORK/long.log")"
+
+./sim $BENCH/fib.elf -e block -l /dev/null -L /dev/null -- 3 > /dev/null 2> "$WORK/warning"
+expect "-l -L with -e block" "Warning: -l and -L run the switch engine, not block" \
+  "$(cat "$WORK/warning")"
+
+finish
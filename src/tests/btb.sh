@@ -0,0 +1,32 @@
+# The BTB and return address stack must count the wrong jal/jalr targets they counted when
+# they were written, for each geometry and replacement policy, and the same on every engine.
+. tests/common.sh
+
+# targets spec: the summary's jump, return and wrong target lines for fib with -B spec
+targets() {
+  ./sim $BENCH/fib.elf -e ${ENGINE:-switch} -B $1 -s "$WORK/fib.sum" -- 25 > /dev/null
+  grep -e '^Total jumps' -e '^Total returns' -e '^Wrong targets' "$WORK/fib.sum" | tr -s ' '
+}
+
+expect "default BTB" "Total jumps executed : 46943
+Wrong targets BTB : 19
+Total returns executed : 12780
+Wrong targets RAS : 0" "$(targets default)"
+expect "direct-mapped fifo BTB, one entry RAS" "Total jumps executed : 46943
+Wrong targets BTB : 9882
+Total returns executed : 12780
+Wrong targets RAS : 222" "$(targets sets=4,ways=1,ras=1,repl=fifo)"
+expect "one set random BTB" "Total jumps executed : 46943
+Wrong targets BTB : 7582
+Total returns executed : 12780
+Wrong targets RAS : 2" "$(targets sets=1,ways=2,ras=2,repl=random)"
+
+reference=$(targets sets=4,ways=1,ras=1,repl=fifo)
+for ENGINE in threaded block jit; do
+  expect "$ENGINE BTB" "$reference" "$(targets sets=4,ways=1,ras=1,repl=fifo)"
+done
+
+./sim $BENCH/fib.elf -B sets=3 -- 1 > /dev/null 2> "$WORK/error" && fail "-B accepted 3 sets"
+expect "bad -B error" "Bad BTB parameter 'sets' in 'sets=3'" "$(cat "$WORK/error")"
+
+finish
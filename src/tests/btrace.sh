@@ -0,0 +1,17 @@
+# Capturing a branch trace must not change the run, and the trace must stay compact: erat's
+# loops should cost no more than three bytes per branch.
+. tests/common.sh
+
+./sim $BENCH/erat.elf -s "$WORK/plain.sum" > "$WORK/plain.out"
+./sim $BENCH/erat.elf -t "$WORK/erat.trace" -s "$WORK/erat.sum" > "$WORK/erat.out" ||
+  fail "erat with -t exited with $?"
+cmp -s "$WORK/plain.out" "$WORK/erat.out" || fail "-t changed the program output"
+diff <(summary_counts "$WORK/plain.sum") <(summary_counts "$WORK/erat.sum") > /dev/null ||
+  fail "-t changed the summary"
+
+expect "trace header" "RVBT" "$(head -c 4 "$WORK/erat.trace")"
+branches=$(summary_value "$WORK/erat.sum" "Total branches executed")
+bytes=$(wc -c < "$WORK/erat.trace")
+[ $((bytes)) -le $((3 * branches)) ] || fail "trace takes $bytes bytes for $branches branches"
+
+finish
@@ -0,0 +1,34 @@
+# Shared by the test scripts. 'make test' runs each of them from src/ after building.
+
+BENCH=../predictor-benchmarks
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+failures=0
+
+fail() {
+  echo "FAIL: $*"
+  failures=$((failures + 1))
+}
+
+# expect what expected actual
+expect() {
+  [ "$2" = "$3" ] || fail "$1: expected '$2', got '$3'"
+}
+
+# The value of one line of a summary written by sim -s, e.g. "Total branches executed"
+summary_value() {
+  sed -n "s/^$2 *: //p" "$1"
+}
+
+finish() {
+  if [ $failures -ne 0 ]; then
+    echo "$(basename "$0"): $failures failure(s)"
+    exit 1
+  fi
+  echo "$(basename "$0"): passed"
+}
+
+# A summary without the host timing, which differs from run to run
+summary_counts() {
+  grep -v -e '^Simulated' -e '^$' "$1"
+}
@@ -0,0 +1,15 @@
+# Guest output goes through the console buffer and print_string's write-string ecall; the
+# benchmarks must print exactly what they printed one character at a time before.
+. tests/common.sh
+
+for engine in switch threaded block jit; do
+  ./sim $BENCH/fib.elf -e $engine -s "$WORK/fib.sum" -- 25 > "$WORK/fib.out"
+  expect "fib to a file, $engine" "fib(25) = 75025" "$(cat "$WORK/fib.out")"
+  expect "erat to a pipe, $engine" "3379080280 538480" \
+    "$(./sim $BENCH/erat.elf -e $engine -s "$WORK/erat.sum" | cksum)"
+done
+
+# The simulator's own last line still comes after everything the guest printed
+expect "fib last line" "Simulated" "$(./sim $BENCH/fib.elf -- 25 | tail -n 1 | cut -d ' ' -f 1)"
+
+finish
@@ -0,0 +1,16 @@
+# The instruction cache decodes the text segment once up front; the benchmarks must still
+# print and execute exactly what they did when every instruction was decoded as it ran.
+. tests/common.sh
+
+./sim $BENCH/fib.elf -s "$WORK/fib.sum" -- 25 > "$WORK/fib.out"
+expect "fib output" "fib(25) = 75025" "$(cat "$WORK/fib.out")"
+expect "fib instructions" 2065923 "$(summary_value "$WORK/fib.sum" "Total executed instructions")"
+expect "fib branches" 197569 "$(summary_value "$WORK/fib.sum" "Total branches executed")"
+
+./sim $BENCH/erat.elf -s "$WORK/erat.sum" > "$WORK/erat.out"
+expect "erat output" "3379080280 538480" "$(cksum < "$WORK/erat.out")"
+expect "erat instructions" 24622711 \
+  "$(summary_value "$WORK/erat.sum" "Total executed instructions")"
+expect "erat branches" 5946398 "$(summary_value "$WORK/erat.sum" "Total branches executed")"
+
+finish
@@ -0,0 +1,25 @@
+# Every dispatch engine must print and count exactly what the switch engine does.
+. tests/common.sh
+
+ENGINES="switch threaded block jit"
+
+for run in "fib -- 25" "erat"; do
+  set -- $run
+  name=$1
+  shift
+  for engine in $ENGINES; do
+    base="$WORK/$name.$engine"
+    ./sim $BENCH/$name.elf -e $engine -s "$base.sum" "$@" > "$base.out" ||
+      fail "$name: $engine exited with $?"
+    cmp -s "$WORK/$name.switch.out" "$base.out" || fail "$name: $engine output differs"
+    diff <(summary_counts "$WORK/$name.switch.sum") <(summary_counts "$base.sum") > /dev/null ||
+      fail "$name: $engine summary differs"
+  done
+done
+
+# Only the switch engine writes the -l log, and the user is told when that overrides -e
+./sim $BENCH/fib.elf -e threaded -l "$WORK/fib.log" -- 10 > /dev/null 2> "$WORK/warning"
+expect "-l with -e threaded" "Warning: -l runs the switch engine, not threaded" \
+  "$(cat "$WORK/warning")"
+
+finish
@@ -0,0 +1,36 @@
+# The benchmark runtime's file ecalls: open, read and write ints in blocks, and close.
+. tests/common.sh
+
+# ints n... writes each n as a little-endian 32-bit int
+ints() {
+  for n in "$@"; do
+    printf "$(printf '%08x' $((n & 0xffffffff)) | sed 's/\(..\)\(..\)\(..\)\(..\)/\\x\4\\x\3\\x\2\\x\1/')"
+  done
+}
+
+# radix adds the positive ints it reads and writes out the N smallest for each -N
+ints 5 3 9 1 -2 7 -1 -10 > "$WORK/small.in"
+./sim $BENCH/radix.elf -- "$WORK/small.in" "$WORK/small.out" > /dev/null ||
+  fail "radix: exited with $?"
+expect "radix small" "1 3 5 7 9" "$(od -An -td4 -v "$WORK/small.out" | xargs)"
+
+# More ints than one read_int_buffer call takes
+numbers=$(awk 'BEGIN { srand(7); for (i = 0; i < 1000; i++) print int(rand() * 1000000) }')
+ints $numbers -1000 > "$WORK/big.in"
+./sim $BENCH/radix.elf -- "$WORK/big.in" "$WORK/big.out" > /dev/null
+expect "radix 1000" "$(echo $numbers | tr ' ' '\n' | sort -n | xargs)" \
+  "$(od -An -td4 -v "$WORK/big.out" | xargs)"
+
+# A pipe that delivers ints cut in two must read the same, as it cannot seek back
+{
+  head -c 5 "$WORK/big.in"
+  sleep 0.2
+  tail -c +6 "$WORK/big.in"
+} | ./sim $BENCH/radix.elf -- /dev/stdin "$WORK/pipe.out" > /dev/null
+cmp -s "$WORK/big.out" "$WORK/pipe.out" || fail "radix: output from a pipe differs"
+
+# A missing input file gives -1 from open_file
+./sim $BENCH/radix.elf -- "$WORK/missing" "$WORK/missing.out" > "$WORK/missing.msg"
+expect "radix missing input" "Could not open input file" "$(head -n 1 "$WORK/missing.msg")"
+
+finish
@@ -0,0 +1,31 @@
+# -H must rank the branches by the misses of the most accurate predictor, most first and ties
+# by address, and the per-branch counts must add up to the totals in the summary.
+. tests/common.sh
+
+./sim $BENCH/fib.elf -H 100 -s "$WORK/fib.sum" -- 25 > /dev/null
+sed -n '/^Most mispredicted/,$p' "$WORK/fib.sum" > "$WORK/table"
+expect "fib ranking" "Most mispredicted of 29 branches, ranked by TAGE" "$(head -1 "$WORK/table")"
+tail -n +3 "$WORK/table" > "$WORK/rows"
+expect "fib branches listed" 29 "$(wc -l < "$WORK/rows")"
+# TAGE misses are the ninth column
+expect "fib ranking order" "$(sort -s -k9,9nr -k1,1 "$WORK/rows")" "$(cat "$WORK/rows")"
+
+expect "fib executions" "$(summary_value "$WORK/fib.sum" "Total branches executed")" \
+  "$(awk '{ sum += $3 } END { print sum }' "$WORK/rows")"
+column=5
+for predictor in NT BTFNT BIMODAL GSHARE TAGE PERCEPTRON; do
+  expect "fib $predictor misses" "$(summary_value "$WORK/fib.sum" "Wrong predictions $predictor")" \
+    "$(awk -v c=$column '{ sum += $c } END { print sum }' "$WORK/rows")"
+  column=$((column + 1))
+done
+
+# With -b the most accurate of the given predictors ranks, and -H limits the rows
+./sim $BENCH/fib.elf -b bimodal -b gshare -H 3 -s "$WORK/top.sum" -- 25 > /dev/null
+expect "fib top three" "Most mispredicted of 29 branches, ranked by GSHARE-1024-H10
+      pc  location                       executions   taken BIMODAL-1024 GSHARE-1024-H10
+   10490  fib+860                             12376   64.7%            1            2063
+   10174  fib+64                              12771    8.9%            1            1394
+   101e0  fib+172                             18872   65.6%            1             800" \
+  "$(sed -n '/^Most mispredicted/,$p' "$WORK/top.sum")"
+
+finish
@@ -0,0 +1,26 @@
+# Flat memory must run every engine exactly like paged memory does. Only paged memory counts
+# its pages, so those lines are left out of the comparison.
+. tests/common.sh
+
+for run in "fib -- 25" "erat"; do
+  set -- $run
+  name=$1
+  shift
+  for engine in switch threaded block jit; do
+    for model in paged flat; do
+      ./sim $BENCH/$name.elf -e $engine -m $model -s "$WORK/$model.sum" "$@" > "$WORK/$model.out" ||
+        fail "$name: $engine on $model memory exited with $?"
+    done
+    cmp -s "$WORK/paged.out" "$WORK/flat.out" || fail "$name: $engine output differs on flat memory"
+    diff <(summary_counts "$WORK/paged.sum" | grep -v '^Pages') <(summary_counts "$WORK/flat.sum") \
+      > /dev/null || fail "$name: $engine summary differs on flat memory"
+  done
+done
+
+# Reading memory that was never written is served from the shared zero page, not allocated
+./sim $BENCH/erat.elf -s "$WORK/erat.sum" > /dev/null
+expect "erat pages allocated" 17 "$(summary_value "$WORK/erat.sum" "Pages allocated")"
+expect "erat pages read from zero page" 1 \
+  "$(summary_value "$WORK/erat.sum" "Pages read from zero page")"
+
+finish
@@ -0,0 +1,15 @@
+# The perceptron must keep mispredicting exactly as often as when it was written, whichever
+# dot product the host CPU selects, in its default and its configured shapes.
+. tests/common.sh
+
+./sim $BENCH/fib.elf -s "$WORK/fib.sum" -- 25 > /dev/null
+expect "fib PERCEPTRON" 174 "$(summary_value "$WORK/fib.sum" "Wrong predictions PERCEPTRON")"
+./sim $BENCH/erat.elf -s "$WORK/erat.sum" > /dev/null
+expect "erat PERCEPTRON" 70 "$(summary_value "$WORK/erat.sum" "Wrong predictions PERCEPTRON")"
+
+./sim $BENCH/fib.elf -b perceptron:history=16 -b perceptron:entries=64,threshold=20 \
+  -s "$WORK/shapes.sum" -- 25 > /dev/null
+expect "fib configured PERCEPTRON" "Wrong predictions PERCEPTRON-256-H16: 114
+Wrong predictions PERCEPTRON-64-H32 : 604" "$(grep '^Wrong' "$WORK/shapes.sum")"
+
+finish
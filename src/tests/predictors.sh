@@ -0,0 +1,33 @@
+# The default predictor set must count what the built-in predictors counted before they became
+# pluggable, and -b must add exactly the predictors it describes.
+. tests/common.sh
+
+# expect_wrong run predictor count
+expect_wrong() {
+  expect "$1 $2" "$3" "$(summary_value "$WORK/$1.sum" "Wrong predictions $2")"
+}
+
+./sim $BENCH/fib.elf -s "$WORK/fib.sum" -- 25 > /dev/null
+expect_wrong fib NT 98937
+expect_wrong fib BTFNT 80376
+expect_wrong fib BIMODAL 12622
+expect_wrong fib GSHARE 7914
+
+./sim $BENCH/erat.elf -s "$WORK/erat.sum" > /dev/null
+expect_wrong erat NT 4553918
+expect_wrong erat BTFNT 313994
+expect_wrong erat BIMODAL 235337
+expect_wrong erat GSHARE 5134
+
+# A configured copy of the default bimodal predictor predicts the same; the name column is as
+# wide as the longest name
+./sim $BENCH/fib.elf -b bimodal:entries=1024,name=BIMODAL-1K-DEFAULT -b gshare:history=8 \
+  -s "$WORK/custom.sum" -- 25 > /dev/null
+expect "custom predictors" "Wrong predictions BIMODAL-1K-DEFAULT: 12622
+Wrong predictions GSHARE-1024-H8    : 9418" "$(grep '^Wrong' "$WORK/custom.sum")"
+
+./sim $BENCH/fib.elf -b bimodal:entries=3 -- 1 > /dev/null 2> "$WORK/error" &&
+  fail "-b accepted a table size that is not a power of two"
+expect "bad -b error" "Predictor table size must be a power of two" "$(cat "$WORK/error")"
+
+finish
@@ -0,0 +1,23 @@
+# predsim must replay an outcome dump (sim -o) and a branch trace (sim -t) to exactly the
+# mispredictions sim counted, however the predictors are spread over threads.
+. tests/common.sh
+
+for run in "fib -- 25" "erat"; do
+  set -- $run
+  name=$1
+  shift
+  ./sim $BENCH/$name.elf -t "$WORK/$name.trace" -o "$WORK/$name.dump" -s "$WORK/$name.sum" \
+    "$@" > /dev/null || fail "$name: run with -t and -o exited with $?"
+  expected=$(grep -e '^Total branches' -e '^Wrong predictions' "$WORK/$name.sum")
+  for replay in dump trace; do
+    for threads in 1 3; do
+      got=$(./predsim "$WORK/$name.$replay" -j $threads | grep -e '^Total branches' -e '^Wrong')
+      expect "$name: predsim -j $threads on the $replay" "$expected" "$got"
+    done
+  done
+done
+
+./predsim "$WORK/fib.sum" > /dev/null 2> "$WORK/error" && fail "predsim replayed a summary"
+expect "predsim error" "$WORK/fib.sum is not a branch outcome dump" "$(cat "$WORK/error")"
+
+finish
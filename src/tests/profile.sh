@@ -0,0 +1,22 @@
+# The -p profile must account for every instruction the run executed, whichever engine counts.
+. tests/common.sh
+
+for engine in switch block jit; do
+  ./sim $BENCH/fib.elf -e $engine -p "$WORK/$engine.prof" -s "$WORK/$engine.sum" -- 25 \
+    > /dev/null
+  insns=$(summary_value "$WORK/$engine.sum" "Total executed instructions")
+  expect "$engine profile total" "Execution profile: $insns instructions" \
+    "$(head -n 1 "$WORK/$engine.prof" | cut -d ' ' -f 1-4)"
+  expect "$engine function sum" "$insns" \
+    "$(awk '{ sum += $NF } END { print sum }' "$WORK/$engine.prof.folded")"
+  [ "$engine" = switch ] || cmp -s "$WORK/switch.prof" "$WORK/$engine.prof" ||
+    fail "$engine profile differs from switch"
+done
+
+# The threaded engine cannot profile, and the user is told the block engine runs instead
+./sim $BENCH/fib.elf -e threaded -p "$WORK/threaded.prof" -- 25 > /dev/null 2> "$WORK/warning"
+expect "-p with -e threaded" "Warning: -p runs the block engine, not threaded" \
+  "$(cat "$WORK/warning")"
+cmp -s "$WORK/switch.prof" "$WORK/threaded.prof" || fail "threaded profile differs from switch"
+
+finish
@@ -0,0 +1,21 @@
+# Every sweep configuration must mispredict exactly as often as the same predictor given
+# with -b, and a spec that selects no configuration is an error.
+. tests/common.sh
+
+./sim $BENCH/erat.elf -w bimodal:entries=256-1024 -w gshare:entries=1024,history=4-5,bits=3 \
+  -b bimodal:entries=256 -b bimodal:entries=512 -b bimodal:entries=1024 \
+  -b gshare:entries=1024,history=4,bits=3 -b gshare:entries=1024,history=5,bits=3 \
+  -s "$WORK/erat.sum" > /dev/null
+swept=$(sed -n '/^Predictor sweep/,$p' "$WORK/erat.sum" | awk 'NR > 1 { print $5 }')
+single=$(awk '/^Wrong predictions/ { print $NF }' "$WORK/erat.sum")
+expect "sweep configurations" 5 "$(echo "$swept" | wc -l)"
+expect "sweep against -b" "$single" "$swept"
+
+for spec in bimodal:entries=300-400 gshare:entries=256,history=9-12 bimodal:entries=9-3 tage; do
+  ./sim $BENCH/fib.elf -w $spec -- 1 > /dev/null 2> "$WORK/error" && fail "-w accepted $spec"
+done
+./sim $BENCH/fib.elf -w bimodal:entries=300-400 -- 1 > /dev/null 2> "$WORK/error"
+expect "empty sweep error" "Sweep 'bimodal:entries=300-400' has no configurations" \
+  "$(cat "$WORK/error")"
+
+finish
@@ -0,0 +1,15 @@
+# TAGE must keep mispredicting exactly as often as when it was written, in its default and
+# its configured shapes.
+. tests/common.sh
+
+./sim $BENCH/fib.elf -s "$WORK/fib.sum" -- 25 > /dev/null
+expect "fib TAGE" 56 "$(summary_value "$WORK/fib.sum" "Wrong predictions TAGE")"
+./sim $BENCH/erat.elf -s "$WORK/erat.sum" > /dev/null
+expect "erat TAGE" 42 "$(summary_value "$WORK/erat.sum" "Wrong predictions TAGE")"
+
+./sim $BENCH/fib.elf -b tage:tables=4 -b tage:tagbits=8,minhist=2 -s "$WORK/shapes.sum" -- 25 \
+  > /dev/null
+expect "fib configured TAGE" "Wrong predictions TAGE-4x1024-H128: 53
+Wrong predictions TAGE-7x1024-H128: 55" "$(grep '^Wrong' "$WORK/shapes.sum")"
+
+finish